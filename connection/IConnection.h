@@ -1,6 +1,8 @@
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <utility>
 
 enum connection_sender_status { OK = 0, DISPLACEMENT_IN_QUEUE = 1, NO_RECEIVERS = 2, ERROR = -1 };
 
@@ -13,6 +15,14 @@ template <typename T> class IConnectionReceiver {
 
     virtual std::shared_ptr<T> waitAndReceive() = 0;
 
+    /**
+     * @brief Вызывает `f` один раз, когда в соединении появятся данные либо закроется последний отправитель. `f`
+     * вызывается в потоке отправителя (или сразу, если данные уже есть), и данные к этому времени может забрать
+     * другой получатель
+     * @return `false`, если соединение не умеет уведомлять получателя: тогда о данных узнают только опросом `receive()`
+     */
+    virtual bool notifyOnData(std::function<void()> f) { return false; }
+
     virtual void close() = 0;
 
     virtual std::shared_ptr<IConnectionReceiver<T>> copy() = 0;
@@ -29,6 +39,18 @@ template <typename T> class IConnectionSender {
 
     virtual int send(const T &val) = 0;
 
+    /**
+     * @brief Отправляет кадр перемещением. По умолчанию - как `send(const T &)`, соединения могут обойтись без копии
+     */
+    virtual int send(T &&val) { return send(static_cast<const T &>(val)); }
+
+    /**
+     * @brief Создаёт кадр сразу в памяти, которую получат получатели, без промежуточного объекта
+     */
+    template <typename... Args> int emplace_send(Args &&...args) {
+        return send(std::make_shared<T>(std::forward<Args>(args)...));
+    }
+
     virtual std::shared_ptr<IConnectionReceiver<T>> getReceiver() = 0;
 
     virtual void close() = 0;
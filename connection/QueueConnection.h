@@ -1,6 +1,7 @@
 #pragma once
 
 #include "IConnection.h"
+#include "frame_pool.h"
 #include "../safe_queue/cyclic_queue.h"
 
 template <typename T> class QueueConnectionSender : public IConnectionSender<T> {
@@ -12,6 +13,9 @@ template <typename T> class QueueConnectionSender : public IConnectionSender<T>
         std::atomic_int receiverCounter{0};
         std::atomic_int senderCounter{1};
 
+        // кадры для `borrow`/`commit`, общие для всех копий отправителя. Может отсутствовать
+        std::unique_ptr<frame_pool<T>> frames;
+
         ConnectionBase(int qCapacity) : data(qCapacity), capacity(qCapacity) {}
     };
 
@@ -72,6 +76,14 @@ template <typename T> class QueueConnectionSender : public IConnectionSender<T>
             }
         }
 
+        bool notifyOnData(std::function<void()> f) override {
+            if (!base) {
+                return false;
+            }
+            base->data.when_pushed(std::move(f));
+            return true;
+        }
+
         void close() override {
             bool current = false;
 
@@ -97,7 +109,17 @@ template <typename T> class QueueConnectionSender : public IConnectionSender<T>
         }
     };
 
-    QueueConnectionSender(int queueCapacity) : base(new ConnectionBase(queueCapacity)) {}
+    QueueConnectionSender(int queueCapacity) : base(new ConnectionBase(queueCapacity)), is_closed(false) {}
+
+    /**
+     * @param framesCount Число заранее созданных кадров для `borrow`/`commit`
+     * @param args Аргументы конструктора каждого кадра
+     */
+    template <typename... Args>
+    QueueConnectionSender(int queueCapacity, std::size_t framesCount, const Args &...args)
+        : QueueConnectionSender(queueCapacity) {
+        base->frames = std::make_unique<frame_pool<T>>(framesCount, args...);
+    }
 
     QueueConnectionSender(QueueConnectionSender &other) : base(other.base), is_closed(false) {
         if (base) {
@@ -138,6 +160,34 @@ template <typename T> class QueueConnectionSender : public IConnectionSender<T>
         return res;
     }
 
+    /**
+     * @brief Отправляет кадр перемещением: одно выделение памяти под кадр в очереди, без копирования содержимого
+     */
+    int send(T &&frame) override { return send(std::make_shared<T>(std::move(frame))); }
+
+    /**
+     * @brief Берёт свободный кадр из пула отправителя, не блокируясь. Кадр заполняется на месте и отправляется
+     * `commit`, тогда он проходит через соединение без копирования и выделения памяти. Кадр возвращается в пул,
+     * когда получатели отпустят его `std::shared_ptr` (или когда его вытеснят из очереди)
+     * @return пустой кадр, если пула нет (отправитель создан без `framesCount`) либо все кадры заняты
+     */
+    typename frame_pool<T>::frame borrow() {
+        if (!base || !base->frames) {
+            return {};
+        }
+        return base->frames->try_borrow();
+    }
+
+    /**
+     * @brief Отправляет кадр, взятый `borrow`
+     */
+    int commit(typename frame_pool<T>::frame &&frame) {
+        if (!frame) {
+            return connection_sender_status::ERROR;
+        }
+        return send(frame.commit());
+    }
+
     std::shared_ptr<IConnectionReceiver<T>> getReceiver() override {
         return std::shared_ptr<QueueConnectionReceiver>(new QueueConnectionReceiver(base));
     }
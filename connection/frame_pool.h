@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Пул заранее созданных кадров для передачи через соединение без копирования и выделения памяти
+ *
+ * - Отправитель берёт свободный кадр (`try_borrow`), заполняет его на месте и отправляет (`frame::commit`).
+ * Получатели получают обычный `std::shared_ptr<T>`, кадр возвращается в пул, когда уходит последняя ссылка на него
+ *
+ * - Объекты кадров и их `std::shared_ptr` создаются один раз при создании пула. Кадр, взятый повторно, хранит
+ * прежнее содержимое (а с ним - выделенную память буферов): перед заполнением его нужно перезаписать или очистить
+ *
+ * - Кадр свободен, если на него ссылается только пул. Захват кадра - один CAS, без блокировок
+ */
+template <typename T> class frame_pool {
+    struct slot {
+        std::shared_ptr<T> value; // ссылка пула, живёт столько же, сколько пул
+        std::atomic_bool lent{false}; // кадр заполняет отправитель
+    };
+
+    std::vector<slot> slots;
+    std::atomic<std::size_t> next{0}; // с какого кадра начинать поиск, чтобы отправители не толкались на первых
+
+  public:
+    /**
+     * @brief Кадр, взятый из пула. Только перемещаемый. Если его не отправить, при разрушении он вернётся в пул.
+     * Не должен пережить пул
+     */
+    class frame {
+        friend class frame_pool;
+
+        slot *s{nullptr};
+
+        explicit frame(slot *s) : s(s) {}
+
+      public:
+        frame() = default;
+        frame(const frame &) = delete;
+        frame(frame &&other) noexcept : s(std::exchange(other.s, nullptr)) {}
+
+        frame &operator=(const frame &) = delete;
+        frame &operator=(frame &&other) noexcept {
+            if (this != &other) {
+                reset();
+                s = std::exchange(other.s, nullptr);
+            }
+            return *this;
+        }
+
+        ~frame() { reset(); }
+
+        /**
+         * @brief `false`, если свободного кадра не нашлось
+         */
+        explicit operator bool() const { return s != nullptr; }
+
+        T &operator*() const { return *s->value; }
+
+        T *operator->() const { return s->value.get(); }
+
+        /**
+         * @brief Возвращает кадр в пул без отправки
+         */
+        void reset() {
+            if (s) {
+                s->lent.store(false, std::memory_order_release);
+                s = nullptr;
+            }
+        }
+
+        /**
+         * @brief Отдаёт заполненный кадр: ссылка на него передаётся получателям, а кадр снова станет свободным, когда
+         * они её отпустят
+         */
+        std::shared_ptr<T> commit() {
+            std::shared_ptr<T> value = s->value;
+            s->lent.store(false, std::memory_order_release);
+            s = nullptr;
+            return value;
+        }
+    };
+
+    /**
+     * @param size Число кадров
+     * @param args Аргументы конструктора каждого кадра
+     */
+    template <typename... Args> explicit frame_pool(std::size_t size, const Args &...args) : slots(size) {
+        for (auto &slot : slots) {
+            slot.value = std::make_shared<T>(args...);
+        }
+    }
+
+    frame_pool(const frame_pool &) = delete;
+    frame_pool &operator=(const frame_pool &) = delete;
+
+    /**
+     * @brief Берёт свободный кадр, не блокируясь
+     * @return пустой `frame`, если все кадры заняты
+     */
+    frame try_borrow() {
+        std::size_t size = slots.size();
+        std::size_t start = next.fetch_add(1, std::memory_order_relaxed);
+
+        for (std::size_t i = 0; i < size; ++i) {
+            slot &s = slots[(start + i) % size];
+            if (s.lent.load(std::memory_order_relaxed) || s.value.use_count() != 1) {
+                continue;
+            }
+
+            bool expected = false;
+            if (!s.lent.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                continue;
+            }
+
+            // пока кадр захвачен, новых ссылок на него не появится, поэтому проверка окончательная
+            if (s.value.use_count() != 1) {
+                s.lent.store(false, std::memory_order_release);
+                continue;
+            }
+
+            // последний получатель отпустил ссылку с барьером release: его чтение кадра завершено
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return frame(&s);
+        }
+
+        return frame{};
+    }
+
+    std::size_t size() const { return slots.size(); }
+};
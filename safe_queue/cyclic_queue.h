@@ -26,17 +26,49 @@ template <typename T> class cyclic_queue : public threadsafe_queue<T> {
      * - Помещает в очередь уже обёрнутое в `std::shared_ptr` значение
      */
     int push(const std::shared_ptr<T> &value) override {
-        std::lock_guard<std::mutex> lg{this->mut};
-
+        std::vector<std::function<void()>> waiters;
         auto res = queue_status::PUSH_OK;
 
-        if (this->data.size() >= capacity) {
-            this->data.pop();
-            res = queue_status::PUSH_WITH_DISPLACEMENT;
+        {
+            std::lock_guard<std::mutex> lg{this->mut};
+
+            if (this->data.size() >= capacity) {
+                this->data.pop();
+                res = queue_status::PUSH_WITH_DISPLACEMENT;
+            }
+
+            this->data.push(value);
+            this->cond.notify_one();
+            waiters = this->take_push_waiters();
         }
+        this->run_push_waiters(waiters);
 
-        this->data.push(value);
-        this->cond.notify_one();
+        return res;
+    }
+
+    /**
+     * @brief
+     * - Помещает в очередь несколько уже обёрнутых в `std::shared_ptr` значений за один захват блокировки. Если
+     * места не хватает, вытесняются самые старые значения
+     */
+    int push_bulk(const std::vector<std::shared_ptr<T>> &values) override {
+        std::vector<std::function<void()>> waiters;
+        auto res = queue_status::PUSH_OK;
+
+        {
+            std::lock_guard<std::mutex> lg{this->mut};
+
+            for (auto &value : values) {
+                if (this->data.size() >= static_cast<std::size_t>(capacity)) {
+                    this->data.pop();
+                    res = queue_status::PUSH_WITH_DISPLACEMENT;
+                }
+                this->data.push(value);
+            }
+            this->notify_waiters(values.size());
+            waiters = this->take_push_waiters();
+        }
+        this->run_push_waiters(waiters);
 
         return res;
     }
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "threadsafe_queue.h"
+
+/**
+ * @brief Потокобезопасная очередь с раздельными подочередями групп (арендаторов). Элементы одной группы извлекаются
+ * в порядке добавления, а группы чередуются по справедливому разделению
+ *
+ * - Каждая группа имеет виртуальное время - потреблённый ресурс, делённый на вес группы. Извлекается элемент группы с
+ * наименьшим виртуальным временем, поэтому при постоянной нагрузке группы получают ресурс пропорционально весам
+ *
+ * - Группа, у которой не было элементов, не копит кредит: при появлении элемента её виртуальное время подтягивается к
+ * времени последней выбранной группы
+ *
+ * - Время добавления O(1), извлечения O(число групп)
+ * @tparam Groups Объект с методами `std::size_t count() const` - число групп, `std::size_t group_of(const T &) const`
+ * - группа элемента из `[0, count)`, `double virtual_time(std::size_t group) const` - виртуальное время группы
+ */
+template <typename T, typename Groups> class threadsafe_fair_queue : public threadsafe_queue<T> {
+    Groups groups;
+    std::vector<std::deque<std::shared_ptr<T>>> queues;
+    std::vector<double> lag; // сдвиг виртуального времени группы, накопленный за время простоя
+    std::size_t total = 0;
+    double clock = 0; // виртуальное время последней выбранной группы
+
+    double time_of(std::size_t group) const { return groups.virtual_time(group) + lag[group]; }
+
+  protected:
+    void put(const std::shared_ptr<T> &value) override {
+        std::size_t group = groups.group_of(*value);
+
+        if (queues[group].empty() && time_of(group) < clock) {
+            lag[group] = clock - groups.virtual_time(group);
+        }
+
+        queues[group].push_back(value);
+        ++total;
+    }
+
+    std::shared_ptr<T> take() override {
+        std::size_t chosen = queues.size();
+        double chosen_time = 0;
+
+        for (std::size_t group = 0; group < queues.size(); ++group) {
+            if (queues[group].empty()) {
+                continue;
+            }
+
+            double time = time_of(group);
+            if (chosen == queues.size() || time < chosen_time) {
+                chosen = group;
+                chosen_time = time;
+            }
+        }
+
+        clock = chosen_time;
+
+        std::shared_ptr<T> value = std::move(queues[chosen].front());
+        queues[chosen].pop_front();
+        --total;
+        return value;
+    }
+
+    bool is_empty() const override { return total == 0; }
+
+    std::size_t count() const override { return total; }
+
+  public:
+    explicit threadsafe_fair_queue(Groups groups)
+        : groups(std::move(groups)), queues(this->groups.count()), lag(this->groups.count(), 0.0) {}
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "threadsafe_queue.h"
+
+/**
+ * @brief Потокобезопасная очередь с приоритетом: первым извлекается элемент, для которого `Before` истинно
+ * относительно всех остальных. Элементы с равным приоритетом извлекаются в порядке добавления
+ *
+ * - Время добавления и извлечения O(log n)
+ * @tparam Before Вызываемый объект `bool(const T &a, const T &b)`: `true`, если `a` нужно извлечь раньше `b`
+ */
+template <typename T, typename Before> class threadsafe_priority_queue : public threadsafe_queue<T> {
+    struct entry {
+        std::shared_ptr<T> value;
+        std::uint64_t order;
+    };
+
+    std::vector<entry> heap;
+    std::uint64_t next_order = 0;
+    Before before;
+
+    // `std::push_heap` держит на вершине наибольший элемент, поэтому "больше" - тот, что извлекается раньше
+    auto later() const {
+        return [this](const entry &a, const entry &b) {
+            if (before(*a.value, *b.value)) {
+                return false;
+            }
+            if (before(*b.value, *a.value)) {
+                return true;
+            }
+            return a.order > b.order;
+        };
+    }
+
+  protected:
+    void put(const std::shared_ptr<T> &value) override {
+        heap.push_back({value, next_order++});
+        std::push_heap(heap.begin(), heap.end(), later());
+    }
+
+    std::shared_ptr<T> take() override {
+        std::pop_heap(heap.begin(), heap.end(), later());
+        std::shared_ptr<T> value = std::move(heap.back().value);
+        heap.pop_back();
+        return value;
+    }
+
+    bool is_empty() const override { return heap.empty(); }
+
+    std::size_t count() const override { return heap.size(); }
+
+  public:
+    explicit threadsafe_priority_queue(Before before = Before{}) : before(std::move(before)) {}
+};
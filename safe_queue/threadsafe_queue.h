@@ -1,9 +1,14 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <mutex>
 #include <condition_variable>
 #include <memory>
 #include <queue>
+#include <vector>
 
 enum queue_status { PUSH_OK = 0, PUSH_WITH_DISPLACEMENT };
 
@@ -13,13 +18,91 @@ template <typename T> class threadsafe_queue {
     std::queue<std::shared_ptr<T>> data;
     std::condition_variable cond;
     volatile std::atomic_bool is_wait_and_pop_enable{true};
+    std::atomic<std::size_t> waiting{0};    // потоки, ожидающие в `wait_and_pop`. Меняется под `mut`
+    std::atomic<std::uint64_t> wakeups{0}; // число вызовов `wake_waiters`. Меняется под `mut`
+    std::vector<std::function<void()>> push_waiters; // обработчики `when_pushed`. Меняется под `mut`
+
+    /**
+     * @brief Хранилище элементов. Наследники, меняющие порядок извлечения, переопределяют эти четыре метода.
+     * Вызываются под `mut`
+     */
+    virtual void put(const std::shared_ptr<T> &value) { data.push(value); }
+
+    virtual std::shared_ptr<T> take() {
+        std::shared_ptr<T> value = data.front();
+        data.pop();
+        return value;
+    }
+
+    virtual bool is_empty() const { return data.empty(); }
+
+    virtual std::size_t count() const { return data.size(); }
+
+    /**
+     * @brief Будит `count` ожидающих потоков (все, если ожидающих не больше `count`). Вызывается под `mut`
+     */
+    void notify_waiters(std::size_t count) {
+        if (count >= waiting) {
+            cond.notify_all();
+            return;
+        }
+
+        for (std::size_t i = 0; i < count; ++i) {
+            cond.notify_one();
+        }
+    }
+
+    /**
+     * @brief Забирает обработчики `when_pushed`. Вызывается под `mut`, а сами обработчики - уже без блокировки
+     */
+    std::vector<std::function<void()>> take_push_waiters() {
+        std::vector<std::function<void()>> waiters;
+        if (!push_waiters.empty()) {
+            waiters.swap(push_waiters);
+        }
+        return waiters;
+    }
+
+    static void run_push_waiters(std::vector<std::function<void()>> &waiters) {
+        for (auto &f : waiters) {
+            f();
+        }
+    }
 
   public:
+    threadsafe_queue() = default;
+    virtual ~threadsafe_queue() = default;
+
     const threadsafe_queue &operator=(const threadsafe_queue &) = delete;
 
     void disable_wait_and_pop() {
-        is_wait_and_pop_enable.store(false);
+        std::vector<std::function<void()>> waiters;
+        {
+            std::lock_guard<std::mutex> lg(mut);
+            is_wait_and_pop_enable.store(false);
+            waiters = take_push_waiters();
+        }
         cond.notify_all();
+        run_push_waiters(waiters);
+    }
+
+    /**
+     * @brief
+     * - Вызывает `f` один раз, когда в очередь поместят элемент либо вызовут `disable_wait_and_pop`. Так можно ждать
+     * элемент, не занимая поток
+     *
+     * - Если очередь не пуста или ожидание уже выключено, `f` вызывается сразу в вызывающем потоке, иначе - в потоке,
+     * поместившем элемент. `f` вызывается без блокировки очереди, элемент к этому времени может забрать другой поток
+     */
+    void when_pushed(std::function<void()> f) {
+        {
+            std::lock_guard<std::mutex> lg(mut);
+            if (is_empty() && is_wait_and_pop_enable) {
+                push_waiters.push_back(std::move(f));
+                return;
+            }
+        }
+        f();
     }
 
     /**
@@ -33,14 +116,15 @@ template <typename T> class threadsafe_queue {
      */
     bool wait_and_pop(T &value) {
         std::unique_lock<std::mutex> lk(mut);
-        cond.wait(lk, [this] { return !data.empty() || is_wait_and_pop_enable == false; });
+        ++waiting;
+        cond.wait(lk, [this] { return !is_empty() || is_wait_and_pop_enable == false; });
+        --waiting;
 
         if (is_wait_and_pop_enable == false) {
             return false;
         }
 
-        value = std::move(*data.front());
-        data.pop();
+        value = std::move(*take());
         return true;
     }
 
@@ -55,16 +139,55 @@ template <typename T> class threadsafe_queue {
      */
     std::shared_ptr<T> wait_and_pop() {
         std::unique_lock<std::mutex> lk(mut);
-        cond.wait(lk, [this] { return !data.empty() || is_wait_and_pop_enable == false; });
+        ++waiting;
+        cond.wait(lk, [this] { return !is_empty() || is_wait_and_pop_enable == false; });
+        --waiting;
         if (is_wait_and_pop_enable == false) {
             return {nullptr};
         }
 
-        std::shared_ptr<T> value = data.front();
-        data.pop();
-        return value;
+        return take();
     }
 
+    /**
+     * @brief
+     * - То же, что `wait_and_pop()`, но ожидание прерывается и вызовом `wake_waiters`, сделанным после того, как
+     * `wakeups_seen()` вернул `seen`. Нужен потоку, который ждёт не только элементов этой очереди
+     * @return `std::shared_ptr<T>(nullptr)`, если ожидание прервано, а очередь по-прежнему пуста
+     */
+    std::shared_ptr<T> wait_and_pop(std::uint64_t seen) {
+        std::unique_lock<std::mutex> lk(mut);
+        ++waiting;
+        cond.wait(lk, [this, seen] { return !is_empty() || is_wait_and_pop_enable == false || wakeups != seen; });
+        --waiting;
+        if (is_wait_and_pop_enable == false || is_empty()) {
+            return {nullptr};
+        }
+
+        return take();
+    }
+
+    /**
+     * @return значение для `wait_and_pop(seen)`. Читается без блокировки
+     */
+    std::uint64_t wakeups_seen() const { return wakeups.load(); }
+
+    /**
+     * @brief Прерывает ожидание потоков в `wait_and_pop(seen)`
+     */
+    void wake_waiters() {
+        std::lock_guard<std::mutex> lg(mut);
+        ++wakeups;
+        if (waiting > 0) {
+            cond.notify_all();
+        }
+    }
+
+    /**
+     * @return есть ли потоки, ожидающие элементов. Читается без блокировки, значение может сразу устареть
+     */
+    bool has_waiters() const { return waiting.load(std::memory_order_relaxed) > 0; }
+
     /**
      * @brief
      * - Если очередь не пуста, перемещает (std::move) `front` элемент в аргумент `value`
@@ -80,11 +203,10 @@ template <typename T> class threadsafe_queue {
      */
     bool try_pop(T &value) {
         std::lock_guard<std::mutex> lg(mut);
-        if (data.empty()) {
+        if (is_empty()) {
             return false;
         }
-        value = std::move(*data.front());
-        data.pop();
+        value = std::move(*take());
         return true;
     }
 
@@ -102,12 +224,10 @@ template <typename T> class threadsafe_queue {
      */
     std::shared_ptr<T> try_pop() {
         std::lock_guard<std::mutex> lg(mut);
-        if (data.empty()) {
+        if (is_empty()) {
             return {nullptr};
         }
-        std::shared_ptr<T> value = data.front();
-        data.pop();
-        return value;
+        return take();
     }
 
     /**
@@ -121,11 +241,7 @@ template <typename T> class threadsafe_queue {
         // копирования перемещением.
         std::shared_ptr<T> new_value(std::make_shared<T>(std::move(value)));
 
-        std::lock_guard<std::mutex> lg(mut);
-        data.push(new_value);
-        cond.notify_one();
-
-        return queue_status::PUSH_OK;
+        return threadsafe_queue::push(new_value);
     }
 
     /**
@@ -133,13 +249,48 @@ template <typename T> class threadsafe_queue {
      * - Помещает в очередь уже обёрнутое в `std::shared_ptr` значение
      */
     virtual int push(const std::shared_ptr<T> &value) {
-        std::lock_guard<std::mutex> lg(mut);
-        data.push(value);
-        cond.notify_one();
+        std::vector<std::function<void()>> waiters;
+        {
+            std::lock_guard<std::mutex> lg(mut);
+            put(value);
+            cond.notify_one();
+            waiters = take_push_waiters();
+        }
+        run_push_waiters(waiters);
+
+        return queue_status::PUSH_OK;
+    }
+
+    /**
+     * @brief
+     * - Помещает в очередь несколько уже обёрнутых в `std::shared_ptr` значений за один захват блокировки
+     *
+     * - Будит не больше потоков, чем добавлено значений
+     * @return статус выполнения
+     */
+    virtual int push_bulk(const std::vector<std::shared_ptr<T>> &values) {
+        std::vector<std::function<void()>> waiters;
+        {
+            std::lock_guard<std::mutex> lg(mut);
+            for (auto &value : values) {
+                put(value);
+            }
+            notify_waiters(values.size());
+            waiters = take_push_waiters();
+        }
+        run_push_waiters(waiters);
 
         return queue_status::PUSH_OK;
     }
 
+    /**
+     * @return количество элементов в очереди на момент вызова
+     */
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lg(mut);
+        return count();
+    }
+
     /**
      * @return
      * - `true` пусто
@@ -147,6 +298,6 @@ template <typename T> class threadsafe_queue {
      */
     bool empty() const {
         std::lock_guard<std::mutex> lg(mut);
-        return data.empty();
+        return is_empty();
     }
 };
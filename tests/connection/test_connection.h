@@ -51,7 +51,7 @@ TEST_F(test_queue_connection, data_transfer) {
         try {
             auto new_data = receiver->receive();
 
-            res += new_data.value_or("");
+            res += new_data ? *new_data : std::string("");
             return {};
         } catch (std::exception &e) {
             res += std::string(e.what());
@@ -70,3 +70,68 @@ TEST_F(test_queue_connection, data_transfer) {
     std::cout << res << std::endl;
     ASSERT_TRUE(res == "Hello, connection receiver. the sender is closed, there will be no more data");
 }
+
+namespace {
+struct counted_frame {
+    static inline int copies = 0;
+
+    std::vector<int> payload;
+
+    counted_frame(std::size_t size, int value) : payload(size, value) {}
+    counted_frame(const counted_frame &other) : payload(other.payload) { ++copies; }
+    counted_frame(counted_frame &&other) = default;
+};
+} // namespace
+
+TEST_F(test_queue_connection, move_and_emplace) {
+    auto sender = std::make_shared<QueueConnectionSender<counted_frame>>(4);
+    auto receiver = sender->getReceiver();
+    tx_connection_ptr<counted_frame> tx = sender;
+
+    counted_frame frame(1000, 1);
+    const int *data = frame.payload.data();
+
+    ASSERT_EQ(tx->send(std::move(frame)), connection_sender_status::OK);
+    ASSERT_EQ(tx->emplace_send(10, 2), connection_sender_status::OK);
+
+    auto moved = receiver->receive();
+    ASSERT_EQ(moved->payload.data(), data); // буфер не копировался
+    ASSERT_EQ(receiver->receive()->payload.size(), 10u);
+    ASSERT_EQ(counted_frame::copies, 0);
+}
+
+TEST_F(test_queue_connection, frame_pool) {
+    QueueConnectionSender<std::vector<int>> sender(8, 2);
+    auto receiver = sender.getReceiver();
+
+    auto first = sender.borrow();
+    auto second = sender.borrow();
+    ASSERT_TRUE(first && second);
+    ASSERT_FALSE(sender.borrow()); // все кадры заняты
+
+    first->assign(100, 7);
+    const int *buffer = first->data();
+    ASSERT_EQ(sender.commit(std::move(first)), connection_sender_status::OK);
+    second.reset(); // не отправлен, вернулся в пул
+
+    {
+        auto received = receiver->receive();
+        ASSERT_EQ(received->size(), 100u);
+        ASSERT_EQ(received->data(), buffer);
+
+        // кадр у получателя: свободен только возвращённый без отправки
+        auto again = sender.borrow();
+        ASSERT_TRUE(again);
+        ASSERT_FALSE(sender.borrow());
+    }
+
+    // получатель отпустил кадр: он снова в пуле вместе со своим буфером
+    std::vector<const int *> buffers;
+    std::vector<frame_pool<std::vector<int>>::frame> frames;
+    for (int i = 0; i < 2; ++i) {
+        frames.push_back(sender.borrow());
+        ASSERT_TRUE(frames.back());
+        buffers.push_back(frames.back()->data());
+    }
+    ASSERT_TRUE(std::find(buffers.begin(), buffers.end(), buffer) != buffers.end());
+}
@@ -3,8 +3,14 @@
 
 #include "thread_pool/test_fine_grained_thread_pool.h"
 #include "thread_pool/test_shared_result.h"
+#include "thread_pool/test_future.h"
+#include "thread_pool/test_parallel_algorithms.h"
+#include "thread_pool/test_task_graph.h"
+#include "thread_pool/test_coroutine.h"
+#include "thread_pool/test_strand.h"
+#include "thread_pool/test_streaming.h"
 #include "connection/test_connection.h"
-// #include "thread_pool/test_task_manager.h"
+#include "thread_pool/test_task_manager.h"
 
 int main(int argc, char *argv[]) {
     ::testing::InitGoogleMock(&argc, argv);
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "../../thread_pool/fine_grained_thread_pool.h"
+#include "../../thread_pool/coroutine.h"
+#include "../../thread_pool/Task.h"
+#include "../../connection/QueueConnection.h"
+
+#if STEPWISE_HAS_COROUTINES
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+
+// соединение, из которого данные можно получить только после `deliver`
+class manual_receiver : public IConnectionReceiver<int> {
+    std::mutex mut;
+    std::deque<int> data;
+
+  public:
+    void deliver(int value) {
+        std::lock_guard<std::mutex> lg{mut};
+        data.push_back(value);
+    }
+
+    std::shared_ptr<int> receive() override {
+        std::lock_guard<std::mutex> lg{mut};
+        if (data.empty()) {
+            return nullptr;
+        }
+        auto value = std::make_shared<int>(data.front());
+        data.pop_front();
+        return value;
+    }
+
+    std::shared_ptr<int> waitAndReceive() override { return receive(); }
+    void close() override {}
+    std::shared_ptr<IConnectionReceiver<int>> copy() override { return nullptr; }
+    int getCapacity() override { return 0; }
+};
+
+// получатель, считающий вызовы `receive`
+class counting_receiver : public IConnectionReceiver<int> {
+    rx_connection_ptr<int> inner;
+
+  public:
+    std::atomic_int receives{0};
+
+    explicit counting_receiver(rx_connection_ptr<int> inner) : inner(std::move(inner)) {}
+
+    std::shared_ptr<int> receive() override {
+        receives.fetch_add(1);
+        return inner->receive();
+    }
+
+    std::shared_ptr<int> waitAndReceive() override { return inner->waitAndReceive(); }
+    bool notifyOnData(std::function<void()> f) override { return inner->notifyOnData(std::move(f)); }
+    void close() override { inner->close(); }
+    std::shared_ptr<IConnectionReceiver<int>> copy() override { return nullptr; }
+    int getCapacity() override { return inner->getCapacity(); }
+};
+
+stepwise::co_task<int> count_steps(int steps, std::atomic_int &done_steps) {
+    for (int i = 0; i < steps; ++i) {
+        done_steps.fetch_add(1);
+        co_await stepwise::next_step();
+    }
+    co_return steps;
+}
+
+stepwise::co_task<int> sum_received(std::shared_ptr<IConnectionReceiver<int>> rx, int count) {
+    int sum = 0;
+    for (int i = 0; i < count; ++i) {
+        sum += *co_await stepwise::async_receive(rx);
+    }
+    co_return sum;
+}
+
+stepwise::co_task<std::string> await_results(stepwise::Task<int>::Result result,
+                                              stepwise::shared_future<int> future) {
+    int first = co_await result;
+    int second = co_await future;
+    co_return std::to_string(first) + "," + std::to_string(second);
+}
+
+stepwise::co_task<bool> hop(fine_grained_thread_pool &pool) {
+    co_await pool.schedule();
+    co_return pool.current_node() == 0;
+}
+
+} // namespace
+
+class test_coroutine : public ::testing::Test {
+  public:
+    void SetUp() { pool = std::make_unique<fine_grained_thread_pool>(1); }
+
+    std::shared_ptr<fine_grained_thread_pool> pool;
+};
+
+TEST_F(test_coroutine, steps_and_cancel) {
+    std::atomic_int done_steps{0};
+    ASSERT_TRUE(count_steps(5, done_steps).start(*pool).get() == 5);
+    ASSERT_TRUE(done_steps == 5);
+
+    std::atomic_int endless_steps{0};
+    auto cancelled = count_steps(1000000, endless_steps).start(*pool, [&endless_steps]() {
+        return endless_steps.load() >= 3;
+    });
+    ASSERT_THROW(cancelled.get(), stepwise::bad_value);
+    ASSERT_TRUE(endless_steps == 3);
+
+    ASSERT_TRUE(hop(*pool).start(*pool).get());
+}
+
+TEST_F(test_coroutine, awaitables) {
+    auto rx = std::make_shared<manual_receiver>();
+    auto sum = sum_received(rx, 3).start(*pool);
+
+    for (int value : {1, 2, 3}) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        rx->deliver(value);
+    }
+    ASSERT_TRUE(sum.get() == 6);
+
+    stepwise::promise<int> later;
+    auto joined = await_results(stepwise::Task<int>::create([]() { return 4; })->share(pool),
+                                later.get_future().share())
+                      .start(*pool);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_FALSE(joined.is_ready());
+    later.set_value(5);
+
+    ASSERT_TRUE(joined.get() == "4,5");
+}
+
+TEST_F(test_coroutine, receive_woken_by_sender) {
+    auto sender = std::make_shared<QueueConnectionSender<int>>(8);
+    auto rx = std::make_shared<counting_receiver>(sender->getReceiver());
+    auto sum = sum_received(rx, 3).start(*pool);
+
+    for (int value : {1, 2, 3}) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        sender->send(value);
+    }
+    ASSERT_TRUE(sum.get() == 6);
+    // пока корутина ждёт, соединение не опрашивается: не больше одной пустой и одной удачной попытки на значение
+    ASSERT_LE(rx->receives.load(), 6);
+
+    // закрытие последнего отправителя тоже продолжает корутину
+    auto rest = sum_received(rx, 1).start(*pool);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    sender->close();
+    ASSERT_THROW(rest.get(), std::logic_error);
+}
+
+#endif
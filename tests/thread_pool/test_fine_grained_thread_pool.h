@@ -5,7 +5,9 @@
 
 #include "../../thread_pool/fine_grained_thread_pool.h"
 
+#include <algorithm>
 #include <chrono>
+#include <functional>
 
 class test_fine_grained_thread_pool : public ::testing::Test {
   public:
@@ -123,3 +125,427 @@ TEST_F(test_fine_grained_thread_pool, kill_stepwise_tasks) {
 
     ASSERT_THROW(f.get(), stepwise::bad_value);
 }
+
+TEST_F(test_fine_grained_thread_pool, cancelled_outcome) {
+    std::atomic_bool flag = false;
+    auto endless_func = []() -> std::optional<int> { return {}; };
+    auto cond = [&flag]() -> bool { return flag; };
+
+    auto f = pool->submit(endless_func, cond);
+    flag = true;
+
+    auto outcome = f.get_outcome();
+    ASSERT_TRUE(outcome.is_cancelled());
+    ASSERT_FALSE(f.valid());
+
+    auto g = pool->submit([]() { return 42; });
+    ASSERT_TRUE(g.get_outcome().value() == 42);
+}
+
+TEST_F(test_fine_grained_thread_pool, pinned_workers) {
+    stepwise::pool_options options;
+    options.number_of_threads = 2;
+    options.cpu_sets = {{0}};
+
+    fine_grained_thread_pool pinned(options);
+
+    auto f = pinned.submit([]() -> int { return sched_getcpu(); });
+
+    ASSERT_TRUE(f.get() == 0);
+}
+
+TEST_F(test_fine_grained_thread_pool, numa_sub_pools) {
+    stepwise::pool_options options;
+    options.numa_aware = true;
+
+    fine_grained_thread_pool numa_pool(options);
+
+    ASSERT_TRUE(numa_pool.nodes_count() == stepwise::numa_topology().size());
+    ASSERT_TRUE(numa_pool.current_node() == -1);
+
+    for (int node = 0; node < (int) numa_pool.nodes_count(); ++node) {
+        auto f = numa_pool.submit([&numa_pool]() -> int { return numa_pool.current_node(); },
+                                  stepwise::submit_options::on_node(node));
+        ASSERT_TRUE(f.get() == node);
+    }
+}
+
+TEST_F(test_fine_grained_thread_pool, metrics_snapshot) {
+    auto stepwise_func = [i = 0]() mutable -> std::optional<int> {
+        if (++i < 3) {
+            return {};
+        }
+        return {i};
+    };
+
+    std::atomic_bool flag = false;
+    auto endless_func = []() -> std::optional<int> { return {}; };
+    auto cond = [&flag]() -> bool { return flag; };
+
+    auto f1 = pool->submit(stepwise_func);
+    auto f2 = pool->submit(endless_func, cond);
+    ASSERT_TRUE(f1.get() == 3);
+    flag = true;
+    ASSERT_THROW(f2.get(), stepwise::bad_value);
+
+    pool->submit([]() { return true; }).wait();
+
+    auto snapshot = pool->metrics();
+
+    ASSERT_TRUE(snapshot.queue_depth.size() == 1);
+#if STEPWISE_POOL_METRICS
+    // результат задачи готов раньше, чем поток пула учтёт её шаг и завершение: ждём, пока учтены все три задачи
+    while (snapshot.steps_per_task.count < 3) {
+        std::this_thread::yield();
+        snapshot = pool->metrics();
+    }
+
+    ASSERT_TRUE(snapshot.workers.size() == 1);
+    ASSERT_TRUE(snapshot.tasks_submitted == 3);
+    ASSERT_TRUE(snapshot.tasks_completed() == 2);
+    ASSERT_TRUE(snapshot.tasks_cancelled() == 1);
+    ASSERT_TRUE(snapshot.steps() >= 5);
+    ASSERT_TRUE(snapshot.wait_before_first_step.count == 3);
+    ASSERT_TRUE(snapshot.steps_per_task.count == 3);
+    ASSERT_TRUE(snapshot.workers[0].busy.count() > 0);
+#endif
+}
+
+TEST_F(test_fine_grained_thread_pool, chrome_trace) {
+    std::stringstream flushed;
+    stepwise::tracer::write_chrome_trace(flushed); // забираем события предыдущих тестов
+
+    auto func = [i = 0]() mutable -> std::optional<int> {
+        if (++i < 3) {
+            return {};
+        }
+        return {i};
+    };
+
+    stepwise::tracer::start();
+    auto f = pool->submit(func, stepwise::submit_options::named("parser \"step\""));
+    ASSERT_TRUE(f.get() == 3);
+    pool->submit([]() { return true; }).wait();
+    stepwise::tracer::stop();
+
+    std::stringstream trace;
+    auto events = stepwise::tracer::write_chrome_trace(trace);
+
+    // submit + 3 * (step begin + step end) + complete для первой задачи и хотя бы submit + step begin для второй
+    ASSERT_TRUE(events >= 10);
+    ASSERT_TRUE(trace.str().find("\"name\":\"parser \\\"step\\\"\",\"cat\":\"step\",\"ph\":\"B\"") != std::string::npos);
+    ASSERT_TRUE(trace.str().find("\"cat\":\"complete\"") != std::string::npos);
+
+    std::stringstream empty;
+    ASSERT_TRUE(stepwise::tracer::write_chrome_trace(empty) <= 3);
+}
+
+TEST_F(test_fine_grained_thread_pool, inline_storage) {
+    auto small = stepwise_function_wrapper::wrap([]() { return 1; }, []() { return false; }, []() { return; });
+
+    std::array<int, 64> payload{};
+    payload.back() = 2;
+    auto large = stepwise_function_wrapper::wrap([payload]() { return payload.back(); }, []() { return false; },
+                                                 []() { return; });
+
+    ASSERT_TRUE(small.function->is_stored_inline());
+    ASSERT_FALSE(large.function->is_stored_inline());
+
+    auto f1 = pool->submit(small);
+    auto f2 = pool->submit(large);
+
+    ASSERT_TRUE(f1.get() + f2.get() == 3);
+}
+
+TEST_F(test_fine_grained_thread_pool, submit_bulk) {
+    std::vector<std::function<std::optional<int>()>> batch;
+    for (int i = 0; i < 1000; ++i) {
+        batch.push_back([i, step = 0]() mutable -> std::optional<int> {
+            if (++step < 2) {
+                return {};
+            }
+            return {i};
+        });
+    }
+
+    auto futures = pool->submit_bulk(batch);
+    ASSERT_TRUE(futures.size() == 1000);
+
+    long long sum = 0;
+    for (auto &future : futures) {
+        sum += future.get();
+    }
+    ASSERT_TRUE(sum == 999 * 1000 / 2);
+}
+
+TEST_F(test_fine_grained_thread_pool, stop_token) {
+    stepwise::stop_source stop;
+    std::atomic_int steps{0};
+    std::atomic_bool noticed{false};
+
+    auto task = [&steps]() -> std::optional<int> {
+        ++steps;
+        return {};
+    };
+
+    auto endless = pool->submit(task, []() { return false; }, [&noticed]() { noticed = true; },
+                                stepwise::submit_options::stoppable(stop.get_token()));
+
+    while (steps < 3) {
+        std::this_thread::yield();
+    }
+    ASSERT_TRUE(stop.request_stop());
+
+    ASSERT_THROW(endless.get(), stepwise::bad_value);
+    ASSERT_TRUE(noticed);
+
+    int steps_after_stop = steps;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ASSERT_TRUE(steps == steps_after_stop);
+}
+
+TEST_F(test_fine_grained_thread_pool, earliest_deadline_first) {
+    stepwise::pool_options options;
+    options.number_of_threads = 1;
+    options.order = stepwise::scheduling::earliest_deadline;
+
+    fine_grained_thread_pool edf_pool(options);
+
+    // занимаем единственный поток, пока очередь заполняется
+    std::atomic_bool started{false}, release{false};
+    auto blocker = edf_pool.submit([&started, &release]() {
+        started = true;
+        while (!release) {
+            std::this_thread::yield();
+        }
+        return true;
+    });
+    while (!started) {
+        std::this_thread::yield();
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::vector<int> order;
+    std::vector<stepwise::future<int>> futures;
+
+    // задачи без срока и с поздними сроками ставятся раньше, но выполняются позже
+    futures.push_back(edf_pool.submit([&order]() {
+        order.push_back(4);
+        return 4;
+    }));
+    for (int i : {3, 1, 2}) {
+        futures.push_back(edf_pool.submit(
+            [&order, i, step = 0]() mutable -> std::optional<int> {
+                if (++step < 2) {
+                    return {};
+                }
+                order.push_back(i);
+                return {i};
+            },
+            stepwise::submit_options::with_deadline(now + std::chrono::seconds(i))));
+    }
+    // срок уже прошёл: задача выполнится первой и попадёт в метрики как опоздавшая
+    futures.push_back(edf_pool.submit(
+        [&order]() {
+            order.push_back(0);
+            return 0;
+        },
+        stepwise::submit_options::with_deadline(now - std::chrono::milliseconds(1))));
+
+    release = true;
+    ASSERT_TRUE(blocker.get());
+    for (auto &future : futures) {
+        future.get();
+    }
+    ASSERT_TRUE(order == (std::vector<int>{0, 1, 2, 3, 4}));
+
+    // единственный поток пула учтёт завершение предыдущих задач раньше, чем выполнит эту
+    edf_pool.submit([]() { return true; }).wait();
+#if STEPWISE_POOL_METRICS
+    ASSERT_TRUE(edf_pool.metrics().deadlines_missed() == 1);
+#endif
+}
+
+TEST_F(test_fine_grained_thread_pool, fair_share_groups) {
+    stepwise::pool_options options;
+    options.number_of_threads = 1;
+    options.order = stepwise::scheduling::fair_share;
+    options.group_weights = {3, 1};
+
+    fine_grained_thread_pool fair_pool(options);
+
+    std::atomic_bool flag{false};
+    auto cond = [&flag]() -> bool { return flag; };
+    // бесконечная задача, каждый шаг которой занимает поток примерно на 20 мкс
+    auto busy = []() -> std::optional<int> {
+        auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(20);
+        while (std::chrono::steady_clock::now() < until) {
+        }
+        return {};
+    };
+
+    // группа 1 ставит в десять раз больше задач, но получает меньше времени: её вес меньше
+    std::vector<stepwise::future<int>> futures;
+    for (int i = 0; i < 50; ++i) {
+        futures.push_back(fair_pool.submit(busy, cond, stepwise::submit_options::in_group(1)));
+    }
+    for (int i = 0; i < 5; ++i) {
+        futures.push_back(fair_pool.submit(busy, cond, stepwise::submit_options::in_group(0)));
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    flag = true;
+    for (auto &future : futures) {
+        ASSERT_THROW(future.get(), stepwise::bad_value);
+    }
+
+    auto snapshot = fair_pool.metrics();
+    ASSERT_TRUE(snapshot.groups.size() == 2);
+    ASSERT_TRUE(snapshot.groups[0].weight == 3);
+    ASSERT_TRUE(snapshot.groups[1].steps > 0);
+    ASSERT_NEAR(snapshot.group_share(0), 0.75, 0.1);
+}
+
+TEST_F(test_fine_grained_thread_pool, help_time_counted_once) {
+    stepwise::pool_options options;
+    options.number_of_threads = 1;
+    options.group_weights = {1, 1};
+
+    fine_grained_thread_pool helping_pool(options);
+
+    // шаг группы 0 ждёт задачу группы 1 и сам выполняет её: время вложенного шага достаётся только группе 1
+    auto outer = helping_pool.submit(
+        [&helping_pool]() -> int {
+            auto inner = helping_pool.submit(
+                []() -> int {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                    return 1;
+                },
+                stepwise::submit_options::in_group(1));
+            return inner.get();
+        },
+        stepwise::submit_options::in_group(0));
+    ASSERT_TRUE(outer.get() == 1);
+
+    // результат готов раньше, чем поток пула учтёт шаг
+    auto snapshot = helping_pool.metrics();
+    while (snapshot.groups[0].steps == 0) {
+        std::this_thread::yield();
+        snapshot = helping_pool.metrics();
+    }
+
+    ASSERT_TRUE(snapshot.groups[1].busy >= std::chrono::milliseconds(50));
+    ASSERT_TRUE(snapshot.groups[0].busy < std::chrono::milliseconds(25));
+#if STEPWISE_POOL_METRICS
+    ASSERT_TRUE(snapshot.workers[0].busy < std::chrono::milliseconds(75));
+#endif
+}
+
+TEST_F(test_fine_grained_thread_pool, help_depth_limited) {
+    fine_grained_thread_pool deep_pool(4);
+
+    static thread_local int depth = 0;
+    std::atomic_int max_depth{0};
+
+    // каждый уровень ждёт следующий, поэтому ожидающие потоки выполняют шаги вложенно
+    std::function<int(int)> chain = [&](int level) -> int {
+        int current = ++depth;
+        int seen = max_depth.load();
+        while (current > seen && !max_depth.compare_exchange_weak(seen, current)) {
+        }
+
+        int value = level == 0 ? 0 : deep_pool.submit([&chain, level]() { return chain(level - 1); }).get() + 1;
+        --depth;
+        return value;
+    };
+
+    ASSERT_TRUE(deep_pool.submit([&chain]() { return chain(40); }).get() == 40);
+    // шаг, взятый потоком из очереди, и не больше 16 шагов, выполненных им в ожидании
+    ASSERT_TRUE(max_depth.load() <= 17);
+}
+
+TEST_F(test_fine_grained_thread_pool, help_depth_boundary) {
+    stepwise::pool_options options;
+    options.max_help_depth = 4;
+
+    static thread_local int depth = 0;
+    std::atomic_int max_depth{0};
+
+    auto chain_in = [&](fine_grained_thread_pool &pool, int levels) {
+        std::function<int(int)> chain = [&](int level) -> int {
+            int current = ++depth;
+            int seen = max_depth.load();
+            while (current > seen && !max_depth.compare_exchange_weak(seen, current)) {
+            }
+
+            int value = level == 0 ? 0 : pool.submit([&chain, level]() { return chain(level - 1); }).get() + 1;
+            --depth;
+            return value;
+        };
+        return pool.submit([&chain, levels]() { return chain(levels); }).get();
+    };
+
+    // цепочка ровно из `max_help_depth` вложенных ожиданий завершается и в пуле из одного потока
+    options.number_of_threads = 1;
+    {
+        fine_grained_thread_pool single(options);
+        ASSERT_EQ(chain_in(single, 4), 4);
+    }
+    ASSERT_EQ(max_depth.load(), 5);
+
+    // следующему уровню нужен свободный поток: ждущий поток его уже не выполняет
+    max_depth = 0;
+    options.number_of_threads = 2;
+    {
+        fine_grained_thread_pool pair(options);
+        ASSERT_EQ(chain_in(pair, 5), 5);
+    }
+    ASSERT_TRUE(max_depth.load() <= 5);
+
+    // предел по умолчанию: 16 вложенных ожиданий в пуле из одного потока
+    max_depth = 0;
+    {
+        fine_grained_thread_pool single(1);
+        ASSERT_EQ(chain_in(single, 16), 16);
+    }
+    ASSERT_EQ(max_depth.load(), 17);
+}
+
+TEST_F(test_fine_grained_thread_pool, affinity) {
+    fine_grained_thread_pool wide_pool(4);
+
+    // каждый шаг запоминает поток, в котором выполнялся. Шаги одной задачи не выполняются одновременно
+    auto stepwise_func = []() {
+        return [threads = std::vector<std::thread::id>{}]() mutable -> std::optional<std::vector<std::thread::id>> {
+            threads.push_back(std::this_thread::get_id());
+            if (threads.size() < 20) {
+                return {};
+            }
+            return {threads};
+        };
+    };
+
+    std::vector<stepwise::future<std::vector<std::thread::id>>> pinned;
+    std::vector<stepwise::future<std::vector<std::thread::id>>> sticky;
+    for (std::size_t key = 0; key < 8; ++key) {
+        pinned.push_back(wide_pool.submit(stepwise_func(), stepwise::submit_options::pinned(key)));
+    }
+    for (int i = 0; i < 100; ++i) {
+        sticky.push_back(wide_pool.submit(stepwise_func(), stepwise::submit_options::sticky()));
+    }
+
+    std::vector<std::thread::id> owners;
+    for (auto &future : pinned) {
+        auto threads = future.get();
+        ASSERT_TRUE(std::count(threads.begin(), threads.end(), threads.front()) == (int) threads.size());
+        owners.push_back(threads.front());
+    }
+    // ключи 0..3 и 4..7 попадают на одни и те же четыре потока
+    for (std::size_t key = 0; key < 4; ++key) {
+        ASSERT_TRUE(owners[key] == owners[key + 4]);
+    }
+
+    for (auto &future : sticky) {
+        ASSERT_TRUE(future.get().size() == 20);
+    }
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "../../thread_pool/future.h"
+
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+TEST(test_future, set_value_from_other_thread) {
+    stepwise::promise<std::string> p;
+    auto f = p.get_future();
+
+    ASSERT_FALSE(f.is_ready());
+    ASSERT_TRUE(f.wait_for(std::chrono::milliseconds(1)) == std::future_status::timeout);
+
+    std::thread producer([p = std::move(p)]() mutable {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        p.set_value("ready");
+    });
+
+    ASSERT_TRUE(f.get() == "ready");
+    ASSERT_FALSE(f.valid());
+
+    producer.join();
+}
+
+TEST(test_future, shared_future_copies) {
+    stepwise::promise<int> p;
+    stepwise::shared_future<int> f1 = p.get_future().share();
+    auto f2 = f1;
+
+    p.set_value(42);
+
+    ASSERT_TRUE(f1.is_ready());
+    ASSERT_TRUE(f1.get() == 42);
+    ASSERT_TRUE(f2.get() == 42);
+    ASSERT_THROW(p.set_value(1), std::future_error);
+}
+
+TEST(test_future, exception_and_broken_promise) {
+    stepwise::future<int> failed;
+    stepwise::future<int> broken;
+
+    {
+        stepwise::promise<int> p1;
+        stepwise::promise<int> p2;
+        failed = p1.get_future();
+        broken = p2.get_future();
+
+        p1.set_exception(std::make_exception_ptr(std::runtime_error("failed")));
+    }
+
+    ASSERT_THROW(failed.get(), std::runtime_error);
+    ASSERT_THROW(broken.get(), std::future_error);
+}
+
+TEST(test_future, on_ready_callbacks) {
+    stepwise::promise<int> p;
+    auto f = p.get_future().share();
+
+    std::string log;
+    f.on_ready([&log](const stepwise::shared_future<int> &ready) { log += "first " + std::to_string(ready.get()); });
+    f.on_ready([&log](const stepwise::shared_future<int> &) { log += ", second"; });
+    ASSERT_TRUE(log.empty());
+
+    p.set_value(7);
+    ASSERT_TRUE(log == "first 7, second");
+
+    f.on_ready([&log](const stepwise::shared_future<int> &) { log += ", immediately"; });
+    ASSERT_TRUE(log == "first 7, second, immediately");
+}
+
+TEST(test_future, when_all_and_when_any) {
+    stepwise::promise<int> p1;
+    stepwise::promise<int> p2;
+    std::vector<stepwise::shared_future<int>> inputs{p1.get_future().share(), p2.get_future().share()};
+
+    auto all = stepwise::when_all(inputs);
+    auto any = stepwise::when_any(inputs);
+    ASSERT_FALSE(all.is_ready());
+    ASSERT_FALSE(any.is_ready());
+
+    p2.set_value(2);
+    ASSERT_FALSE(all.is_ready());
+    ASSERT_TRUE(any.is_ready());
+    ASSERT_TRUE(any.get().index == 1);
+    ASSERT_TRUE(any.get().value == 2);
+
+    p1.set_value(1);
+    ASSERT_TRUE(all.is_ready());
+    ASSERT_TRUE(all.get() == std::vector<int>({1, 2}));
+
+    stepwise::promise<int> p3;
+    auto failed = stepwise::when_all(std::vector<stepwise::shared_future<int>>{inputs[0], p3.get_future().share()});
+    p3.set_exception(std::make_exception_ptr(std::runtime_error("failed")));
+    ASSERT_THROW(failed.get(), std::runtime_error);
+
+    ASSERT_TRUE(stepwise::when_all(std::vector<stepwise::shared_future<int>>{}).get().empty());
+    ASSERT_THROW(stepwise::when_any(std::vector<stepwise::shared_future<int>>{}).get(), std::invalid_argument);
+}
+
+TEST(test_future, outcome_without_exceptions) {
+    stepwise::promise<int> cancelled;
+    auto cancelled_future = cancelled.get_future().share();
+    cancelled.set_cancelled();
+
+    auto cancelled_outcome = cancelled_future.get_outcome();
+    ASSERT_TRUE(cancelled_outcome.is_cancelled());
+    ASSERT_FALSE(cancelled_outcome);
+    ASSERT_TRUE(cancelled_outcome.error() == nullptr);
+    ASSERT_TRUE(cancelled_outcome.value_or(-1) == -1);
+    ASSERT_TRUE(cancelled_future.status() == stepwise::task_status::cancelled);
+    // обычный `get()` по-прежнему сообщает об отмене исключением
+    ASSERT_THROW(cancelled_future.get(), stepwise::bad_value);
+
+    stepwise::promise<std::string> completed;
+    auto completed_future = completed.get_future().share();
+    completed.set_value("value");
+    auto completed_outcome = completed_future.get_outcome();
+    ASSERT_TRUE(completed_outcome.has_value());
+    ASSERT_TRUE(&*completed_outcome == &completed_future.get()); // без копирования
+    ASSERT_TRUE(completed_outcome->size() == 5);
+
+    stepwise::promise<int> failed;
+    auto failed_future = failed.get_future();
+    failed.set_exception(std::make_exception_ptr(std::runtime_error("failed")));
+    auto failed_outcome = failed_future.get_outcome();
+    ASSERT_TRUE(failed_outcome.status() == stepwise::task_status::failed);
+    ASSERT_THROW(failed_outcome.value(), std::runtime_error);
+    ASSERT_FALSE(failed_future.valid());
+
+    // отмена любого из входов отменяет объединённый результат
+    stepwise::promise<int> ready;
+    auto ready_future = ready.get_future().share();
+    ready.set_value(1);
+    auto all = stepwise::when_all(std::vector<stepwise::shared_future<int>>{ready_future, cancelled_future});
+    ASSERT_TRUE(all.get_outcome().is_cancelled());
+}
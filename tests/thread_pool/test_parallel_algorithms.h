@@ -0,0 +1,113 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "../../thread_pool/fine_grained_thread_pool.h"
+#include "../../thread_pool/parallel_algorithms.h"
+
+#include <atomic>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+class test_parallel_algorithms : public ::testing::Test {
+  public:
+    void SetUp() { pool = std::make_unique<fine_grained_thread_pool>(4); }
+
+    std::unique_ptr<fine_grained_thread_pool> pool;
+};
+
+TEST_F(test_parallel_algorithms, parallel_for) {
+    std::vector<std::atomic_int> visits(100000);
+
+    stepwise::parallel_for(*pool, 0, (int) visits.size(), [&](int i) { visits[i].fetch_add(1); });
+
+    for (auto &visit : visits) {
+        ASSERT_TRUE(visit.load() == 1);
+    }
+
+    ASSERT_THROW(stepwise::parallel_for(*pool, 0, 1000,
+                                        [](int i) {
+                                            if (i == 500) {
+                                                throw std::runtime_error("failed");
+                                            }
+                                        }),
+                 std::runtime_error);
+}
+
+TEST_F(test_parallel_algorithms, parallel_for_inside_task) {
+    // вызывающий поток сам выполняет итерации, поэтому вложенный цикл не ждёт свободного потока пула
+    fine_grained_thread_pool single(1);
+
+    auto sum = single.submit([&single]() {
+        std::atomic_int sum{0};
+        stepwise::parallel_for(single, 0, 1000, [&sum](int i) { sum += i; });
+        return sum.load();
+    });
+
+    ASSERT_TRUE(sum.get() == 999 * 1000 / 2);
+}
+
+TEST_F(test_parallel_algorithms, transform_reduce) {
+    std::vector<long long> values(100000);
+    std::iota(values.begin(), values.end(), 1);
+
+    long long squares = stepwise::parallel_transform_reduce(
+        *pool, values.begin(), values.end(), 0LL, std::plus<>(), [](long long value) { return value * value; });
+
+    ASSERT_TRUE(squares == std::transform_reduce(values.begin(), values.end(), 0LL, std::plus<>(),
+                                                 [](long long value) { return value * value; }));
+}
+
+TEST_F(test_parallel_algorithms, sort) {
+    std::mt19937 random(42);
+
+    for (std::size_t size : {0, 1, 100, 5000, 100003}) {
+        std::vector<int> values(size);
+        for (auto &value : values) {
+            value = (int) (random() % 1000);
+        }
+
+        auto expected = values;
+        std::sort(expected.begin(), expected.end(), std::greater<>());
+
+        stepwise::parallel_sort(*pool, values.begin(), values.end(), std::greater<>());
+
+        ASSERT_TRUE(values == expected);
+    }
+}
+
+TEST_F(test_parallel_algorithms, scan) {
+    for (std::size_t size : {0, 1, 100, 5000, 100003}) {
+        std::vector<long long> values(size);
+        std::iota(values.begin(), values.end(), 1);
+
+        std::vector<long long> expected(size);
+        std::inclusive_scan(values.begin(), values.end(), expected.begin());
+
+        std::vector<long long> scanned(size);
+        auto end = stepwise::parallel_scan(*pool, values.begin(), values.end(), scanned.begin());
+        ASSERT_TRUE(end == scanned.end());
+        ASSERT_TRUE(scanned == expected);
+
+        stepwise::parallel_scan(*pool, values.begin(), values.end(), values.begin());
+        ASSERT_TRUE(values == expected);
+    }
+}
+
+TEST_F(test_parallel_algorithms, scan_strings) {
+    // перемещение строки опустошает источник: сдвиги блоков не должны теряться между проходами
+    std::vector<std::string> values(5000);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        values[i] = std::string(1, (char) ('a' + i % 26));
+    }
+
+    std::vector<std::string> expected(values.size());
+    std::inclusive_scan(values.begin(), values.end(), expected.begin());
+
+    std::vector<std::string> scanned(values.size());
+    stepwise::parallel_scan(*pool, values.begin(), values.end(), scanned.begin());
+    ASSERT_TRUE(scanned == expected);
+}
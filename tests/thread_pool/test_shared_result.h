@@ -9,6 +9,7 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <future>
 
 using namespace stepwise;
 
@@ -38,10 +39,9 @@ TEST_F(test_shared_result, reference_count) {
     std::stringstream log;
     auto notice = [&log]() mutable -> void { log << "stop"; };
 
-    block->share(pool, Task<int>::create(task, cond, notice));
-
     {
-        auto res = block->share(pool);
+        // первый результат держится до конца блока: потеря всех результатов отменяет задачу сразу
+        auto res = block->share(pool, Task<int>::create(task, cond, notice));
         auto res1 = block->share(pool);
         auto res2 = block->share(pool);
         auto res3 = block->share(pool);
@@ -86,3 +86,300 @@ TEST_F(test_shared_result, vector) {
 
     ASSERT_TRUE(log.str() == ans);
 }
+
+TEST_F(test_shared_result, then_chain) {
+    auto task = [step = 0]() mutable -> std::optional<int> {
+        if (++step < 3) {
+            return {};
+        }
+        return {step};
+    };
+
+    auto chained = Task<int>::create(task)
+                       ->share(pool)
+                       .then(pool, [](const int &value) { return value * 2; })
+                       .then(pool, [](const int &value) { return std::to_string(value); });
+
+    ASSERT_TRUE(chained.get() == "6");
+
+    auto failed = Task<int>::create([]() -> int { throw std::runtime_error("failed"); })
+                      ->share(pool)
+                      .then(pool, [](const int &value) { return value + 1; });
+
+    ASSERT_THROW(failed.get(), std::runtime_error);
+}
+
+TEST_F(test_shared_result, when_all_and_when_any) {
+    auto counter = [](int steps) {
+        return [steps, step = 0]() mutable -> std::optional<int> {
+            if (++step < steps) {
+                return {};
+            }
+            return {step};
+        };
+    };
+
+    std::vector<Task<int>::Result> results{Task<int>::create(counter(3))->share(pool),
+                                           Task<int>::create(counter(5))->share(pool)};
+
+    auto all = when_all(results);
+    ASSERT_TRUE(all.get() == std::vector<int>({3, 5}));
+
+    std::atomic_bool endless_stopped{false};
+    auto endless = Task<int>::create([]() -> std::optional<int> { return {}; },
+                                     [&endless_stopped]() { endless_stopped = true; });
+
+    std::vector<Task<int>::Result> racing{endless->share(pool), Task<int>::create(counter(2))->share(pool)};
+    auto any = when_any(racing, true);
+    racing.clear();
+
+    ASSERT_TRUE(any.get().index == 1);
+    ASSERT_TRUE(any.get().value == 2);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    ASSERT_TRUE(endless_stopped);
+}
+
+TEST_F(test_shared_result, wait_inside_worker) {
+    // в пуле один поток: ожидая результат вложенной задачи, он сам выполняет её шаги
+    auto outer = Task<int>::create([this]() -> int {
+                     auto inner = Task<int>::create([step = 0]() mutable -> std::optional<int> {
+                                      if (++step < 3) {
+                                          return {};
+                                      }
+                                      return {step};
+                                  })->share(pool);
+                     inner.wait();
+                     return inner.get() + 1;
+                 })->share(pool);
+
+    ASSERT_TRUE(outer.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    ASSERT_TRUE(outer.get() == 4);
+}
+
+TEST_F(test_shared_result, holders_in_result_state) {
+    auto endless = Task<int>::create([]() -> std::optional<int> { return {}; });
+
+    ASSERT_TRUE(endless->has_active_results()); // задача ещё не запускалась
+
+    {
+        auto first = endless->share(pool);
+        auto second = endless->share(pool); // задача уже выполняется: тот же результат
+        auto third = second;
+        auto moved = std::move(third);
+
+        ASSERT_TRUE(first.count() == 3);
+        ASSERT_TRUE(endless->has_active_results());
+
+        moved = first;
+        ASSERT_TRUE(first.count() == 3);
+        ASSERT_FALSE(first.is_ready());
+    }
+
+    // последний держатель отменил запуск, а результат отменённой задачи проверяется без исключения
+    ASSERT_FALSE(endless->has_active_results());
+
+    auto restarted = endless->share(pool);
+    restarted.cancel();
+    ASSERT_TRUE(restarted.get_outcome().is_cancelled());
+}
+
+TEST_F(test_shared_result, abandoned_task_leaves_queue) {
+    // единственный поток пула занят, поэтому задача ниже так и ждёт в очереди
+    std::atomic_bool release{false};
+    auto blocker = pool->submit([&]() -> std::optional<int> {
+        while (!release.load()) {
+            std::this_thread::yield();
+        }
+        return 0;
+    });
+
+    std::atomic_int steps{0};
+    std::atomic_bool notified{false};
+    auto queued = Task<int>::create([&]() -> std::optional<int> { return ++steps; }, [&]() { notified.store(true); });
+
+    queued->share(pool); // результат сразу уничтожен
+
+    // обработчик завершения вызван сразу, не дожидаясь очереди
+    ASSERT_TRUE(notified.load());
+    ASSERT_FALSE(queued->has_active_results());
+
+    release.store(true);
+    blocker.get();
+
+    // надгробие в очереди пропущено без шага
+    pool->submit([]() { return 0; }).get();
+    ASSERT_EQ(steps.load(), 0);
+}
+
+TEST_F(test_shared_result, make_task) {
+    std::atomic_int notices{0};
+    std::atomic_bool go{false};
+
+    // каждый запуск начинает с копии вызываемого объекта, как у `Task::create`
+    auto counter = make_task([step = 0, &go]() mutable -> std::optional<int> {
+        if (!go.load()) {
+            return {};
+        }
+        ++step;
+        if (step % 3 != 0) {
+            return {};
+        }
+        return step;
+    }, [&notices]() { notices.fetch_add(1); });
+
+    task_ptr<int> erased = counter;
+
+    auto first = counter->share(pool);
+    auto joined = erased->share(pool);
+    go.store(true);
+    ASSERT_EQ(first.get(), 3);
+    ASSERT_EQ(joined.get(), 3);
+
+    auto second = counter->share(pool);
+    ASSERT_EQ(second.get(), 3);
+    ASSERT_EQ(notices.load(), 2);
+
+    // функции задачи заданы при создании
+    ASSERT_THROW(counter->share(pool, Task<int>::create([]() { return 0; })), std::logic_error);
+
+    auto plain = make_task([]() { return std::string("value"); });
+    ASSERT_EQ(plain->share(pool).get(), "value");
+
+    auto stopped = make_task([]() -> std::optional<int> { return {}; }, []() { return true; }, []() {});
+    ASSERT_TRUE(stopped->share(pool).get_outcome().is_cancelled());
+
+    // запуск, отменённый посреди работы, не оставляет следующему свой счётчик шагов
+    std::atomic_int calls{0};
+    std::atomic_bool cancel_once{true};
+    auto restarted = make_task([step = 0, &calls]() mutable -> std::optional<int> {
+        calls.fetch_add(1);
+        if (++step < 4) {
+            return {};
+        }
+        return step;
+    }, [&]() { return calls.load() == 2 && cancel_once.exchange(false); }, []() {});
+
+    ASSERT_TRUE(restarted->share(pool).get_outcome().is_cancelled());
+    ASSERT_EQ(restarted->share(pool).get(), 4);
+    ASSERT_EQ(calls.load(), 6);
+}
+
+TEST_F(test_shared_result, concurrent_share) {
+    constexpr int THREADS = 8;
+    constexpr int SHARES = 1000;
+
+    std::atomic_int runs{0};
+    std::atomic_bool go{false};
+    auto hot = make_task([&]() -> std::optional<int> {
+        if (!go.load()) {
+            return {};
+        }
+        return runs.fetch_add(1) + 1;
+    });
+
+    std::vector<std::vector<Task<int>::Result>> results(THREADS);
+    {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; ++t) {
+            threads.emplace_back([&, t]() {
+                for (int i = 0; i < SHARES; ++i) {
+                    results[t].push_back(hot->share(pool));
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    // пока задача выполнялась, все вызовы `share` присоединились к одному запуску
+    ASSERT_EQ(results[0][0].count(), THREADS * SHARES);
+
+    go.store(true);
+    for (auto &per_thread : results) {
+        for (auto &result : per_thread) {
+            ASSERT_EQ(result.get(), 1);
+        }
+    }
+    ASSERT_EQ(runs.load(), 1);
+}
+
+TEST_F(test_shared_result, share_after_abandoned_run) {
+    std::atomic_bool in_step{false};
+    std::atomic_bool go{false};
+
+    auto task = Task<int>::create([&, i = 0]() mutable -> std::optional<int> {
+        in_step.store(true);
+        while (!go.load()) {
+            std::this_thread::yield();
+        }
+        if (++i < 3) {
+            return {};
+        }
+        return 42;
+    });
+
+    {
+        auto first = task->share(pool);
+        while (!in_step.load()) {
+            std::this_thread::yield();
+        }
+    } // последний `Result` уничтожен посреди шага: запуск отменится после него
+
+    std::thread release([&go]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        go.store(true);
+    });
+
+    // к отменяемому запуску не присоединяемся: `share` дожидается его и ставит новый
+    auto second = task->share(pool);
+    release.join();
+
+    ASSERT_EQ(second.get_outcome().is_cancelled(), false);
+    ASSERT_EQ(second.get(), 42);
+}
+
+TEST_F(test_shared_result, notice_reshares_task) {
+    for (bool typed : {false, true}) {
+        for (bool cancel_first : {false, true}) {
+            std::atomic_int runs{0};
+            std::atomic_bool stop_once{cancel_first};
+            std::atomic_bool reshared{false};
+            std::promise<Task<int>::Result> again;
+            task_ptr<int> task;
+
+            // два шага: после первого `cond` может отменить запуск
+            auto body = [&runs, step = 0]() mutable -> std::optional<int> {
+                if (++step < 2) {
+                    return {};
+                }
+                return runs.fetch_add(1) + 1;
+            };
+            auto cond = [&stop_once]() { return stop_once.exchange(false); };
+            // к вызову обработчика задача уже неактивна: `share` из него ставит новый запуск
+            auto notice = [&]() {
+                if (!reshared.exchange(true)) {
+                    again.set_value(task->share(pool));
+                }
+            };
+
+            task = typed ? make_task(body, cond, notice) : Task<int>::create(body, cond, notice);
+
+            auto first = task->share(pool);
+            if (cancel_first) {
+                ASSERT_TRUE(first.get_outcome().is_cancelled());
+            } else {
+                ASSERT_EQ(first.get(), 1);
+            }
+
+            auto second = again.get_future().get();
+            ASSERT_FALSE(second.get_outcome().is_cancelled());
+            ASSERT_EQ(second.get(), runs.load());
+            if (!cancel_first) {
+                ASSERT_EQ(second.get(), 2);
+            }
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "../../thread_pool/fine_grained_thread_pool.h"
+#include "../../thread_pool/strand.h"
+
+#include <stdexcept>
+#include <vector>
+
+class test_strand : public ::testing::Test {
+  public:
+    void SetUp() { pool = std::make_unique<fine_grained_thread_pool>(4); }
+
+    std::unique_ptr<fine_grained_thread_pool> pool;
+};
+
+TEST_F(test_strand, fifo_per_strand) {
+    constexpr int strands_count = 4;
+    constexpr int tasks_count = 2000;
+
+    std::vector<stepwise::strand> strands;
+    // у каждого `strand` свой журнал без блокировок: задачи одного `strand` не пересекаются во времени
+    std::vector<std::vector<int>> logs(strands_count);
+    std::vector<stepwise::future<int>> results;
+
+    for (int i = 0; i < strands_count; ++i) {
+        strands.emplace_back(*pool);
+    }
+
+    for (int task = 0; task < tasks_count; ++task) {
+        for (int i = 0; i < strands_count; ++i) {
+            results.push_back(strands[i].post([&log = logs[i], task]() {
+                log.push_back(task);
+                return task;
+            }));
+        }
+    }
+
+    for (auto &result : results) {
+        result.get();
+    }
+
+    for (auto &log : logs) {
+        ASSERT_EQ(log.size(), tasks_count);
+        for (int task = 0; task < tasks_count; ++task) {
+            EXPECT_EQ(log[task], task);
+        }
+    }
+}
+
+TEST_F(test_strand, stepwise_and_errors) {
+    stepwise::strand strand(*pool);
+    std::vector<int> log;
+
+    // пошаговая задача удерживает `strand`, пока не вернёт значение
+    auto stepped = strand.post([&log, step = 0]() mutable -> std::optional<int> {
+        log.push_back(step);
+        if (++step < 3) {
+            return {};
+        }
+        return {step};
+    });
+    auto failed = strand.post([]() -> int { throw std::runtime_error("strand"); });
+    auto last = strand.post([&log]() {
+        log.push_back(-1);
+        return true;
+    });
+
+    EXPECT_EQ(stepped.get(), 3);
+    EXPECT_THROW(failed.get(), std::runtime_error);
+    EXPECT_TRUE(last.get());
+    EXPECT_EQ(log, (std::vector<int>{0, 1, 2, -1}));
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "../../thread_pool/fine_grained_thread_pool.h"
+#include "../../thread_pool/streaming.h"
+#include "../../connection/QueueConnection.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace stepwise;
+
+class test_streaming : public ::testing::Test {
+  public:
+    void SetUp() { pool = std::make_unique<fine_grained_thread_pool>(2); }
+
+    std::shared_ptr<fine_grained_thread_pool> pool;
+};
+
+TEST_F(test_streaming, partial_results) {
+    auto tx = std::make_shared<QueueConnectionSender<int>>(64);
+    auto rx = tx->getReceiver();
+
+    std::atomic_int consumed{0};
+
+    // разбор "файла" по строке за шаг: каждая строка уходит получателю сразу, итог - число строк
+    auto parse = [line = 0, &consumed](IConnectionSender<int> &out) mutable -> std::optional<int> {
+        if (line == 3) {
+            // получатель начал обработку до того, как задача закончилась
+            while (consumed.load() == 0) {
+                std::this_thread::yield();
+            }
+        }
+
+        if (line == 6) {
+            return line;
+        }
+        out.send(line * 10);
+        ++line;
+        return {};
+    };
+
+    auto total = submit_streaming(*pool, tx, parse);
+
+    std::vector<int> partials;
+    for (;;) {
+        try {
+            auto value = rx->receive();
+            if (value) {
+                partials.push_back(*value);
+                consumed.fetch_add(1);
+            } else {
+                std::this_thread::yield();
+            }
+        } catch (std::logic_error &) {
+            break; // задача закрыла соединение
+        }
+    }
+
+    ASSERT_EQ(partials, (std::vector<int>{0, 10, 20, 30, 40, 50}));
+    ASSERT_EQ(total.get(), 6);
+}
+
+TEST_F(test_streaming, closed_on_cancel) {
+    auto tx = std::make_shared<QueueConnectionSender<std::string>>(4);
+    auto rx = tx->getReceiver();
+
+    std::atomic_bool stop{false};
+    auto endless = [](IConnectionSender<std::string> &out) -> std::optional<int> {
+        out.send(std::string("tick"));
+        return {};
+    };
+
+    auto result = submit_streaming(*pool, tx, endless, [&]() { return stop.load(); });
+
+    ASSERT_TRUE(*rx->waitAndReceive() == "tick");
+    stop.store(true);
+
+    ASSERT_TRUE(result.get_outcome().is_cancelled());
+    ASSERT_THROW(
+        for (;;) { rx->receive(); }, std::logic_error);
+}
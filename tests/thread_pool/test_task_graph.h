@@ -0,0 +1,76 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "../../thread_pool/fine_grained_thread_pool.h"
+#include "../../thread_pool/task_graph.h"
+
+#include <atomic>
+#include <string>
+
+class test_task_graph : public ::testing::Test {
+  public:
+    // одного потока достаточно: вершины не ждут друг друга, блокируя поток
+    void SetUp() { pool = std::make_unique<fine_grained_thread_pool>(1); }
+
+    std::unique_ptr<fine_grained_thread_pool> pool;
+};
+
+TEST_F(test_task_graph, diamond) {
+    stepwise::task_graph graph;
+    std::atomic_int source_calls{0};
+
+    auto source = graph.emplace([&source_calls]() {
+        ++source_calls;
+        return 10;
+    });
+    auto doubled = graph.emplace([](const int &value) { return value * 2; }, source);
+    // пошаговая вершина: значение появляется на третьем подходе, счётчик шагов свой в каждом прогоне
+    auto stepped = graph.emplace(
+        [step = 0](const int &value) mutable -> std::optional<int> {
+            if (++step < 3) {
+                return {};
+            }
+            return {value + step};
+        },
+        source);
+    auto joined = graph.emplace([](const int &a, const int &b) { return std::to_string(a) + "," + std::to_string(b); },
+                                doubled, stepped);
+
+    ASSERT_TRUE(graph.size() == 4);
+
+    ASSERT_TRUE(graph.run(*pool).get() == 1);
+    ASSERT_TRUE(joined.get() == "20,13");
+
+    ASSERT_TRUE(graph.run(*pool).get() == 2);
+    ASSERT_TRUE(joined.get() == "20,13");
+    ASSERT_TRUE(source_calls == 2);
+}
+
+TEST_F(test_task_graph, order_and_errors) {
+    stepwise::task_graph graph;
+    std::string log;
+
+    auto first = graph.emplace([&log]() {
+        log += "first ";
+        return 1;
+    });
+    auto failing = graph.emplace([](const int &) -> int { throw std::runtime_error("failed"); }, first);
+    auto skipped = graph.emplace([&log](const int &) {
+        log += "skipped ";
+        return 2;
+    }, failing);
+    auto last = graph.emplace([&log]() {
+        log += "last";
+        return 3;
+    });
+    graph.precede(first, last);
+
+    ASSERT_THROW(graph.run(*pool).get(), std::runtime_error);
+    ASSERT_TRUE(log == "first last");
+    ASSERT_FALSE(skipped.has_value());
+
+    graph.precede(last, first);
+    ASSERT_THROW(graph.run(*pool), std::logic_error);
+}
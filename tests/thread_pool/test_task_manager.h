@@ -6,13 +6,14 @@
 #include "../../thread_pool/fine_grained_thread_pool.h"
 #include "../../thread_pool/TaskManager.h"
 
+#include <atomic>
 #include <iostream>
 #include <thread>
 #include <chrono>
 
 using namespace stepwise;
 
-class test_shared_result : public ::testing::Test {
+class test_task_manager : public ::testing::Test {
   public:
     void SetUp() { pool = std::make_unique<fine_grained_thread_pool>(1); }
 
@@ -24,7 +25,7 @@ class test_shared_result : public ::testing::Test {
     TaskManager<int> tm{};
 };
 
-TEST_F(test_shared_result, test_add) {
+TEST_F(test_task_manager, test_add) {
     std::cout << "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA" << std::endl;
 
     std::string ans = "stop";
@@ -46,7 +47,7 @@ TEST_F(test_shared_result, test_add) {
         auto res1 = Task<int>::Result{};
         auto res2 = Task<int>::Result{};
 
-        tm.template add(0, pool, task, cond, notice);
+        tm.add(0, pool, task, cond, notice);
         // auto res1 = tm.add(1, pool, task, cond, std::move(notice));
         // auto res2 = tm.add(2, pool, task, cond, notice);
         // auto res3 = tm.add(3, pool, task, cond, notice);
@@ -59,7 +60,111 @@ TEST_F(test_shared_result, test_add) {
     ASSERT_TRUE(log.str() == ans);
 }
 
-// TEST_F(test_shared_result, vector) {
+TEST_F(test_task_manager, single_flight) {
+    std::atomic_int runs{0};
+    std::atomic_bool release{false};
+
+    auto task = [&]() -> std::optional<int> {
+        if (!release.load()) {
+            return {};
+        }
+        return ++runs;
+    };
+
+    std::vector<Task<int>::Result> results;
+    for (int i = 0; i < 8; ++i) {
+        results.push_back(tm.add(7, pool, task));
+    }
+    auto other = tm.add(8, pool, task);
+
+    ASSERT_EQ(tm.in_flight(), 2u);
+    ASSERT_EQ(results[0].count(), 8);
+
+    release.store(true);
+    for (auto &result : results) {
+        ASSERT_EQ(result.get(), results[0].get());
+    }
+    other.wait();
+    ASSERT_EQ(runs.load(), 2);
+
+    // готовый результат отдаётся из кэша, задача не запускается
+    auto cached = tm.add(7, pool, task);
+    ASSERT_TRUE(cached.is_ready());
+    ASSERT_EQ(cached.get(), results[0].get());
+    ASSERT_EQ(runs.load(), 2);
+    ASSERT_FALSE(tm.find(7).empty());
+
+    tm.invalidate(7);
+    ASSERT_TRUE(tm.find(7).empty());
+    tm.add(7, pool, task).wait();
+    ASSERT_EQ(runs.load(), 3);
+}
+
+TEST_F(test_task_manager, concurrent_single_flight) {
+    std::atomic_int runs{0};
+    std::atomic_bool release{false};
+
+    auto task = [&]() -> std::optional<int> {
+        if (!release.load()) {
+            return {};
+        }
+        return ++runs;
+    };
+
+    // задача ставится в пул уже без блокировки сегмента: одновременные запросы всё равно получают один запуск
+    std::vector<Task<int>::Result> results(8);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        threads.emplace_back([&, i]() { results[i] = tm.add(7, pool, task); });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(tm.in_flight(), 1u);
+    ASSERT_EQ(results[0].count(), 8);
+
+    release.store(true);
+    for (auto &result : results) {
+        ASSERT_EQ(result.get(), 1);
+    }
+    ASSERT_EQ(runs.load(), 1);
+}
+
+TEST_F(test_task_manager, cache_eviction) {
+    task_manager_options opts;
+    opts.shards = 1;
+    opts.capacity = 2;
+    opts.ttl = std::chrono::milliseconds(50);
+    TaskManager<int> small{opts};
+
+    std::atomic_int runs{0};
+    auto task = [&]() -> int { return ++runs; };
+
+    // кэш заполняется обработчиком готовности, он может отстать от `wait`
+    auto settle = [&](Task<int>::Result result) {
+        result.wait();
+        while (small.in_flight() != 0) {
+            std::this_thread::yield();
+        }
+    };
+
+    settle(small.add(1, pool, task));
+    settle(small.add(2, pool, task));
+    settle(small.add(1, pool, task)); // 1 - последний запрошенный, вытеснен будет 2
+    settle(small.add(3, pool, task));
+
+    ASSERT_EQ(runs.load(), 3);
+    ASSERT_EQ(small.cached(), 2u);
+    ASSERT_FALSE(small.find(1).empty());
+    ASSERT_TRUE(small.find(2).empty());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    ASSERT_TRUE(small.find(1).empty());
+    ASSERT_EQ(small.add(1, pool, task).get(), 4);
+}
+
+// TEST_F(test_task_manager, vector) {
 //     constexpr int TASKS_NUMBER = 1000;
 
 //     std::vector<stepwise::Task<int>::Result> results;
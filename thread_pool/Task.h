@@ -1,19 +1,27 @@
 #pragma once
 
 #include <atomic>
-#include <future>
 #include <mutex>
 #include <memory>
 #include <functional>
+#include <optional>
+#include <stdexcept>
+#include <thread>
 #include <type_traits>
+#include <utility>
 
 #include <iostream>
 
+#include "coroutine.h"
 #include "fine_grained_thread_pool.h"
+#include "future.h"
+#include "run_gate.h"
 #include "stepwise_function_wrapper.h"
 
 namespace stepwise {
 
+template <typename T, typename Key, typename Hash> class TaskManager;
+
 template <typename T> class Task : public std::enable_shared_from_this<Task<T>> {
   public:
     /**
@@ -24,114 +32,210 @@ template <typename T> class Task : public std::enable_shared_from_this<Task<T>>
      */
     class Result {
         friend class Task;
+        template <typename, typename, typename> friend class TaskManager;
 
       private:
-        // Результат задачи
-        std::shared_future<T> task_future;
-
-        // Счетчик ссылок на результат задачи
-        std::shared_ptr<std::atomic_int> result_reference_count;
+        // Общее состояние результата задачи. В нём же считаются держатели результата и хранится отмена запуска,
+        // поэтому копирование и разрушение `Result` - одна атомарная операция
+        result_state<T> *block{nullptr};
 
         /**
          * @brief Конструктор. Создает Result, связанный с задачей.
          *
-         * @param future Результат задачи.
+         * @param future Результат задачи, к которому уже привязана отмена запуска.
          */
-        Result(const std::shared_future<T> &future) noexcept
-            : result_reference_count(std::make_shared<std::atomic_int>(1)), task_future(future) {}
+        explicit Result(const shared_future<T> &future) noexcept : block(detail::result_access::state(future)) {
+            if (block) {
+                block->add_holder();
+            }
+        }
+
+        shared_future<T> future() const { return detail::result_access::share(*block); }
+
+        // держатель выполняющегося запуска `run`. Пустой, если запуск уже отменяется: его результат никто не ждёт
+        static Result attach(const shared_future<T> &run) {
+            Result result;
+            result_state<T> *state = detail::result_access::state(run);
+            if (state->try_add_holder()) {
+                result.block = state;
+            }
+            return result;
+        }
 
       public:
         /**
          * @brief Конструктор по умолчанию. Создает пустой объект Result.
          */
-        Result() : result_reference_count(nullptr) {}
+        Result() = default;
 
         /**
          * @brief Конструктор копирования.
          */
-        Result(const Result &other) noexcept
-            : result_reference_count(other.result_reference_count), task_future(other.task_future) {
-            if (result_reference_count) {
-                result_reference_count->fetch_add(1);
+        Result(const Result &other) noexcept : block(other.block) {
+            if (block) {
+                block->add_holder();
             }
         }
 
         /**
          * @brief Конструктор перемещения.
          */
-        Result(Result &&other) noexcept
-            : result_reference_count(std::move(other.result_reference_count)),
-              task_future(std::move(other.task_future)) {
-            other.result_reference_count = nullptr;
-        }
+        Result(Result &&other) noexcept : block(std::exchange(other.block, nullptr)) {}
 
         /**
-         * @brief Деструктор. Уменьшает счетчик ссылок.
+         * @brief Деструктор. Уменьшает счетчик ссылок. Если это была последняя ссылка, задача отменяется: её
+         * результат больше никто не ждёт. Задача, ждущая своей очереди в пуле, снимается сразу: обработчик
+         * завершения вызывается в этом потоке, а потоки пула пропускают её без шага
          */
         ~Result() {
-            if (result_reference_count) {
-                result_reference_count->fetch_sub(1);
+            if (block) {
+                block->release_holder();
             }
         }
 
         /**
          * @brief Возвращает количество активных ссылок на результат задачи.
          */
-        int count() const { return result_reference_count ? result_reference_count->load() : 1; }
+        int count() const { return block ? (int) block->holders() : 1; }
 
         /**
          * @brief Ожидает завершения задачи.
          */
-        void wait() const { task_future.wait(); }
+        void wait() const { block->wait(); }
 
         /**
          * @brief Ожидает завершения задачи с таймаутом.
          */
         template <class Rep, class Period>
         std::future_status wait_for(const std::chrono::duration<Rep, Period> &timeout_duration) const {
-            return task_future.wait_for(timeout_duration);
+            return block->wait_for(timeout_duration);
         }
 
         /**
          * @brief Проверяет, готов ли результат задачи.
          */
-        bool is_ready() const {
-            return task_future.wait_for(std::chrono::milliseconds(0)) == std::future_status::ready;
-        }
+        bool is_ready() const { return block && block->is_ready(); }
 
         /**
          * @brief Возвращает результат задачи.
          */
-        const T &get() const { return task_future.get(); }
+        const T &get() const {
+            block->wait();
+            return block->get();
+        }
+
+        /**
+         * @brief Возвращает итог задачи: значение, отмену или исключение. Отменённая задача (`cancel`, `kill`) не
+         * приводит к выбросу исключения
+         */
+        outcome<const T &> get_outcome() const { return future().get_outcome(); }
+
+        /**
+         * @brief Продолжение: когда задача завершится, в пул `pool` будет поставлена задача `f(get())`. Поток при этом
+         * не блокируется. Пока продолжение не выполнено, оно считается активной ссылкой на результат задачи
+         * @return `shared_future` результата `f`, у которого тоже есть `then`
+         */
+        template <typename F> auto then(const std::shared_ptr<fine_grained_thread_pool> &pool, F &&f) const {
+            return future().then(
+                pool, [keep = *this, f = std::forward<F>(f)](const T &value) mutable { return f(value); });
+        }
 
         /**
          * @brief проверяет связан ли результат с какой-то задачей
          */
-        bool empty() { return result_reference_count.get() == nullptr; }
+        bool empty() { return block == nullptr; }
+
+        /**
+         * @brief Отменяет запуск задачи, породивший результат: очередной шаг не выполнится, а в результате окажется
+         * `stepwise::bad_value`. Если задача уже завершена, ничего не делает
+         */
+        void cancel() const {
+            if (block && !block->is_ready()) {
+                block->request_stop();
+            }
+        }
 
         // Оператор присваивания
         Result &operator=(Result other) {
-            std::swap(result_reference_count, other.result_reference_count);
-            std::swap(task_future, other.task_future);
+            std::swap(block, other.block);
             return *this;
         }
+
+        /**
+         * @brief Результат готов, когда завершены все задачи `results`. Ожидающий поток не нужен. Пока итоговый
+         * результат не готов, `results` считаются активными ссылками на свои задачи
+         * @return значения задач в порядке `results`
+         */
+        friend shared_future<std::vector<T>> when_all(const std::vector<Result> &results) {
+            std::vector<shared_future<T>> futures;
+            for (auto &result : results) {
+                futures.push_back(result.future());
+            }
+
+            auto all = stepwise::when_all(futures);
+            all.on_ready([keep = results](const shared_future<std::vector<T>> &) {});
+            return all;
+        }
+
+        /**
+         * @brief Результат готов, как только завершена любая из задач `results`. Ожидающий поток не нужен
+         * @param cancel_losers Отменить (`Result::cancel`) задачи, которые ещё не закончились к этому моменту
+         * @return номер первой завершившейся задачи и её значение
+         */
+        friend shared_future<when_any_result<T>> when_any(const std::vector<Result> &results,
+                                                          bool cancel_losers = false) {
+            std::vector<shared_future<T>> futures;
+            for (auto &result : results) {
+                futures.push_back(result.future());
+            }
+
+            auto any = stepwise::when_any(futures);
+            any.on_ready([keep = results, cancel_losers](const shared_future<when_any_result<T>> &) {
+                if (cancel_losers) {
+                    for (auto &loser : keep) {
+                        loser.cancel();
+                    }
+                }
+            });
+            return any;
+        }
+
+#if STEPWISE_HAS_COROUTINES
+        /**
+         * @brief `co_await result` в корутине: поток не блокируется, корутина продолжится, когда задача завершится
+         */
+        friend detail::future_awaiter<T> operator co_await(const Result &result) {
+            return detail::future_awaiter<T>{result.future()};
+        }
+#endif
     };
 
   private:
-    // Указывает, активна ли задача (выполняется ли она в данный момент)
-    std::atomic_bool is_task_active{false};
+    // фаза запуска задачи и читатели `current_run`: `share` к выполняющейся задаче не берёт блокировок
+    detail::run_gate gate;
 
     std::atomic_bool kill_flag{false};
 
-    std::mutex share_lock_mut;
+    // защищает только настройки запусков (имя, привязку), которые читаются при постановке нового запуска
+    std::mutex config_mut;
+
+    // имя задачи в трассе пула
+    const char *name = nullptr;
 
-    std::function<bool(void)> cancel_condition{[]() { return false; }};
+    // привязка шагов задачи к потоку пула
+    stepwise::affinity affinity_mode = stepwise::affinity::none;
+    std::size_t affinity_key = 0;
+
+    // пользовательское условие досрочного завершения, может быть пустым
+    std::function<bool(void)> cancel_condition{};
 
     std::function<void(void)> on_complete{[]() { return; }};
 
     std::function<std::optional<T>(void)> main_func;
 
-    Result result;
+    // результат текущего запуска. Не держатель: ожидающими считаются только выданные `Result`. Пишется только в
+    // фазе `starting`, читается под закреплением `gate`
+    shared_future<T> current_run;
 
     // Приватный конструктор для создания объекта через фабричный метод
 
@@ -139,12 +243,7 @@ template <typename T> class Task : public std::enable_shared_from_this<Task<T>>
          std::function<void(void)> on_complete)
         : main_func(main_func), cancel_condition(cancel_condition), on_complete(on_complete) {}
 
-    auto wrap_service_function() {
-        auto wrapped_cancel_cond = [=, con_cond = cancel_condition,
-                                    control_block = this->shared_from_this()]() mutable -> bool {
-            return con_cond() || !control_block->has_active_results() || control_block->need_to_kill();
-        };
-
+    wrapped_function<T> wrap_service_function() {
         auto wrapped_callback = [=, on_compl = on_complete,
                                  control_block = this->shared_from_this()]() mutable -> void {
             control_block->mark_task_as_complete();
@@ -153,11 +252,89 @@ template <typename T> class Task : public std::enable_shared_from_this<Task<T>>
 
         auto wrapped_task = [=, main_f = main_func]() mutable -> std::optional<T> { return main_f(); };
 
-        return stepwise_function_wrapper::wrap(std::move(wrapped_task), std::move(wrapped_cancel_cond),
-                                               std::move(wrapped_callback));
+        // `kill` и потеря всех результатов отменяют задачу через `stop_source` запуска, пул проверяет его одной
+        // атомарной загрузкой. `cond()` остаётся только для пользовательского условия
+        if (!cancel_condition) {
+            return stepwise_function_wrapper::wrap(std::move(wrapped_task), []() { return false; },
+                                                   std::move(wrapped_callback));
+        }
+
+        return stepwise_function_wrapper::wrap(
+            std::move(wrapped_task), [con_cond = cancel_condition]() mutable -> bool { return con_cond(); },
+            std::move(wrapped_callback));
+    }
+
+    // ставит задачу в пул и запоминает результат нового запуска. Вызывается в фазе `starting`
+    Result submit_run(std::shared_ptr<fine_grained_thread_pool> &pool) {
+        wrapped_function<T> task_base;
+        stepwise::submit_options opts;
+        Result result;
+
+        try {
+            task_base = wrap_run();
+
+            kill_flag.store(false);
+
+            stop_source stop;
+            {
+                std::lock_guard<std::mutex> lg{config_mut};
+                opts = stepwise::submit_options::named(name);
+                opts.affinity = affinity_mode;
+                opts.affinity_key = affinity_key;
+            }
+            opts.stop = stop.get_token();
+
+            // отмена связывается с результатом до постановки в пул: последний ушедший `Result` снимет задачу, даже
+            // если до неё ещё не дошла очередь
+            current_run = task_base.future.share();
+            auto state = detail::result_access::state(current_run);
+            state->set_stop_source(std::move(stop));
+            state->set_canceller(task_base.function, &stepwise_function_wrapper::cancel_queued);
+
+            result = Result(current_run);
+
+            pool->submit(task_base, opts);
+        } catch (...) {
+            // запуск, не попавший в пул, отменяется, пока задача в фазе `starting`: его обработчик завершения не
+            // застанет следующий запуск
+            result = Result{};
+            gate.abandon();
+            throw;
+        }
+
+        // если запуск успел завершиться до публикации, задача сразу вернётся в `idle`
+        gate.started();
+
+        return result;
+    }
+
+    // присоединяется к опубликованному запуску после `gate.enter` либо `gate.join`
+    Result join_run() {
+        Result result = Result::attach(current_run);
+        gate.unpin();
+        return result;
     }
 
+    // копия `current_run`, которую не перезапишет параллельный новый запуск
+    shared_future<T> pinned_run() {
+        gate.pin();
+        shared_future<T> run = current_run;
+        gate.unpin();
+        return run;
+    }
+
+  protected:
+    // для задач из `make_task`: функции хранит наследник, а не `std::function`
+    Task() = default;
+
+    /**
+     * @brief Обёртка нового запуска для пула. Вызывается из `share` одним потоком, пока задача не активна
+     */
+    virtual wrapped_function<T> wrap_run() { return wrap_service_function(); }
+
   public:
+    virtual ~Task() = default;
+
     /**
      * @brief Фабричный метод для создания объекта Task.
      *
@@ -173,17 +350,49 @@ template <typename T> class Task : public std::enable_shared_from_this<Task<T>>
 
     static auto
     create(std::function<std::optional<T>(void)> main_func, std::function<void(void)> on_complete = []() { return; }) {
-        auto instance = Task<T>::create(main_func, []() { return false; }, on_complete);
+        auto instance = Task<T>::create(main_func, nullptr, on_complete);
 
         return instance;
     }
 
-    void kill() { kill_flag.store(true); }
+    /**
+     * @brief Задаёт имя, под которым шаги задачи попадут в трассу пула (`stepwise::tracer`)
+     */
+    void set_name(const std::string &task_name) {
+        std::lock_guard<std::mutex> lg{config_mut};
+        name = tracer::intern(task_name);
+    }
+
+    /**
+     * @brief Задаёт привязку шагов задачи к потоку пула для следующих запусков (`submit_options::affinity`)
+     * @param key Ключ выбора потока для `affinity::hard`
+     */
+    void set_affinity(stepwise::affinity mode, std::size_t key = 0) {
+        std::lock_guard<std::mutex> lg{config_mut};
+        affinity_mode = mode;
+        affinity_key = key;
+    }
+
+    /**
+     * @brief Отменяет текущий запуск задачи: очередной шаг уже не выполнится, а в результате окажется
+     * `stepwise::bad_value`
+     */
+    void kill() {
+        kill_flag.store(true);
+        shared_future<T> run = pinned_run();
+
+        // задача в очереди отменяется в этом потоке, а её обработчик завершения может снова обратиться к задаче
+        if (run.valid() && !run.is_ready()) {
+            detail::result_access::state(run)->request_stop();
+        }
+    }
 
     bool need_to_kill() { return kill_flag.load(); }
 
     /**
      * @brief Связывает задачу с пулом потоков. Если задача уже выполняется, возвращает существующий результат.
+     * Запуск, который уже отменяется (все его `Result` уничтожены либо вызван `kill`), не продолжается: `share`
+     * дожидается его завершения и ставит новый.
      *
      * @param pool Пул потоков, в котором будет выполняться задача.
      * @param task Задача, которая будет выполняться.
@@ -192,54 +401,69 @@ template <typename T> class Task : public std::enable_shared_from_this<Task<T>>
      * @return Result<T> Объект, представляющий результат задачи.
      */
     Result share(std::shared_ptr<fine_grained_thread_pool> &pool) {
-        std::lock_guard<std::mutex> lg{share_lock_mut};
-
-        bool current = false;
-
-        Result resToRet;
-        // Если задача не активна, инициализируем новую задачу
-        if (is_task_active.compare_exchange_strong(current, true)) {
-            auto task_base = wrap_service_function();
-
-            kill_flag.store(false);
-
-            result = Result(pool->submit(task_base).share()); // result_reference_count = 1;
-            resToRet = result;                                // result_reference_count = 2;
-            result.result_reference_count->store(1);          // result_reference_count = 1;
-        } else {
-            resToRet = result; // после завершения функции всего будет 1 копия снаружи и одна копия внутри
+        while (true) {
+            switch (gate.enter()) {
+            case detail::run_gate::admission::join:
+                // задача выполняется: один CAS и новая ссылка держателя
+                if (Result result = join_run(); !result.empty()) {
+                    return result;
+                }
+
+                // запуск уже отменяется (его `Result` уничтожены либо вызван `kill`): дожидаемся его завершения и
+                // ставим новый
+                std::this_thread::yield();
+                break;
+
+            case detail::run_gate::admission::start:
+                // Если задача не активна, инициализируем новую задачу
+                return submit_run(pool);
+
+            case detail::run_gate::admission::wait:
+                std::this_thread::yield();
+            }
         }
-
-        return resToRet;
     }
 
-    Result share(std::shared_ptr<fine_grained_thread_pool> &pool, std::shared_ptr<Task<T>> other_ptr) {
-        std::lock_guard<std::mutex> lg{share_lock_mut};
-
+    /**
+     * @brief Как `share(pool)`, но новый запуск выполняет функции задачи `other_ptr`
+     * @throw `std::logic_error` для задачи из `make_task`: её функции заданы при создании
+     */
+    virtual Result share(std::shared_ptr<fine_grained_thread_pool> &pool, std::shared_ptr<Task<T>> other_ptr) {
         Task<T> &other = *other_ptr;
 
-        bool current = false;
+        while (true) {
+            switch (gate.enter()) {
+            case detail::run_gate::admission::join:
+                if (Result result = join_run(); !result.empty()) {
+                    return result;
+                }
 
-        Result resToRet;
+                std::this_thread::yield();
+                break;
 
-        // Если задача не активна, инициализируем новую задачу
-        if (is_task_active.compare_exchange_strong(current, true)) {
-            main_func = other.main_func;
-            cancel_condition = other.cancel_condition;
-            on_complete = other.on_complete;
+            case detail::run_gate::admission::start:
+                // Если задача не активна, инициализируем новую задачу
+                main_func = other.main_func;
+                cancel_condition = other.cancel_condition;
+                on_complete = other.on_complete;
 
-            auto task_base = wrap_service_function();
+                return submit_run(pool);
 
-            kill_flag.store(false);
-
-            result = Result(pool->submit(task_base).share()); // result_reference_count = 1;
-            resToRet = result;                                // result_reference_count = 2;
-            result.result_reference_count->store(1);          // result_reference_count = 1;
-        } else {
-            resToRet = result; // после завершения функции всего будет 1 копия снаружи и одна копия внутри
+            case detail::run_gate::admission::wait:
+                std::this_thread::yield();
+            }
         }
+    }
 
-        return resToRet;
+    /**
+     * @brief Присоединяется к выполняющемуся запуску задачи, не ставя новый
+     * @return пустой `Result`, если задача не выполняется либо её запуск уже отменяется
+     */
+    Result join() {
+        if (!gate.join()) {
+            return Result{};
+        }
+        return join_run();
     }
 
     /**
@@ -248,13 +472,16 @@ template <typename T> class Task : public std::enable_shared_from_this<Task<T>>
      * @return true Если есть активные ссылки на результат задачи.
      * @return false Если никто не ожидает результат задачи.
      */
-    bool has_active_results() { return result.count() > 0; }
+    bool has_active_results() {
+        shared_future<T> run = pinned_run();
+        return !run.valid() || detail::result_access::state(run)->holders() > 0;
+    }
 
     /**
      * @brief Уведомляет, что задача завершена.
      * Этот метод должен быть вызван в обработчике завершения задачи.
      */
-    void mark_task_as_complete() { is_task_active.store(false); }
+    void mark_task_as_complete() { gate.complete(); }
 
     Task(const Task<T> &) = delete;
 
@@ -266,4 +493,72 @@ template <typename T> class Task : public std::enable_shared_from_this<Task<T>>
 
 template <typename T> using task_ptr = std::shared_ptr<Task<T>>;
 
+namespace detail {
+
+/**
+ * @brief `Task`, функции которой хранятся с исходными типами. Как и `Task::create`, каждый запуск работает с копиями
+ * исходных функций, но копии лежат в обёртке для пула как есть: вызовы встраиваются, а `share` не выделяет память
+ * под `std::function`
+ */
+template <typename T, typename F, typename Cond, typename Notice> class static_task final : public Task<T> {
+    struct functions {
+        F body;
+        Cond cond;
+        Notice notice;
+    };
+
+    const functions original;
+
+    wrapped_function<T> wrap_run() override {
+        // как у `Task::create`: задача становится неактивной раньше обработчика завершения, поэтому `share` из
+        // обработчика ставит новый запуск. Копия `notice` живёт в обёртке и переживает этот запуск
+        return stepwise_function_wrapper::wrap(
+            [body = original.body]() mutable { return body(); },
+            [cond = original.cond]() mutable -> bool { return cond(); },
+            [notice = original.notice, self = this->shared_from_this()]() mutable {
+                self->mark_task_as_complete();
+                notice();
+            });
+    }
+
+  public:
+    static_task(F body, Cond cond, Notice notice) : original{std::move(body), std::move(cond), std::move(notice)} {}
+
+    using Task<T>::share;
+
+    typename Task<T>::Result share(std::shared_ptr<fine_grained_thread_pool> &,
+                                   std::shared_ptr<Task<T>>) override {
+        throw std::logic_error("make_task: functions of the task cannot be replaced");
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief Создаёт `Task` без стирания типов: `f`, `c` и `n` хранятся как есть, без `std::function`. Результат -
+ * обычные `task_ptr<T>` и `Task<T>::Result`
+ *
+ * - Как и у `Task::create`, каждый запуск начинает с копий `f`, `c` и `n`: состояние `f` (например, счётчик шагов)
+ * не переходит из запуска в запуск, даже если запуск отменён посреди работы
+ *
+ * - `share(pool, other)` для такой задачи выбрасывает `std::logic_error`: её функции заданы при создании
+ * @param f Вызываемый объект, возвращающий `std::optional<T>` (либо просто `T`)
+ * @param c Вызываемый объект, возвращающий `bool` - условие досрочного завершения задачи
+ * @param n Вызываемый объект, обработчик завершения задачи
+ */
+template <typename F, typename Cond, typename Notice> auto make_task(F f, Cond c, Notice n) {
+    using value_type = typename stepwise_function_wrapper::value_of<F>::type;
+    using task_type = detail::static_task<value_type, F, Cond, Notice>;
+
+    return task_ptr<value_type>(std::make_shared<task_type>(std::move(f), std::move(c), std::move(n)));
+}
+
+template <typename F, typename Notice> auto make_task(F f, Notice n) {
+    return make_task(std::move(f), []() { return false; }, std::move(n));
+}
+
+template <typename F> auto make_task(F f) {
+    return make_task(std::move(f), []() { return; });
+}
+
 } // namespace stepwise
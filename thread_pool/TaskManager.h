@@ -0,0 +1,374 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Task.h"
+#include "fine_grained_thread_pool.h"
+#include "future.h"
+
+namespace stepwise {
+
+/**
+ * @brief Параметры `stepwise::TaskManager`
+ */
+struct task_manager_options {
+    // число сегментов таблицы ключей. Запросы к ключам разных сегментов не конкурируют за блокировку
+    std::size_t shards = 16;
+
+    // сколько готовых результатов хранится всего (делится поровну между сегментами). `0` - результаты не хранятся
+    std::size_t capacity = 1024;
+
+    // сколько готовый результат отдаётся из кэша, после этого задача для ключа запускается заново
+    std::chrono::steady_clock::duration ttl = std::chrono::minutes(1);
+};
+
+/**
+ * @brief Таблица задач по ключу: одинаковые запросы, пришедшие одновременно, получают результат одного запуска
+ * задачи (single-flight), а готовые результаты какое-то время отдаются из кэша без запуска
+ *
+ * - Пока задача ключа выполняется, `add` присоединяет запрос к её текущему запуску через `Task::join`. Новая задача
+ * не создаётся, а `f`, `cond` и `notice` запроса не используются. Запуск, который уже отменяется, не продолжается:
+ * ключ сразу переходит к новой задаче
+ *
+ * - Значение завершившейся задачи попадает в кэш сегмента с вытеснением давно не запрошенных (LRU) и сроком жизни
+ * `ttl`. Исключения и отмены не кэшируются: следующий запрос запустит задачу заново
+ *
+ * - Ключи распределены по сегментам, у каждого своя блокировка. Задачи ставятся в пул и завершаются без удержания
+ * блокировок сегментов
+ *
+ * - Отмена прежняя: если все `Result` запуска уничтожены до его завершения, задача отменяется
+ * @tparam T Тип результата задачи
+ * @tparam Key Тип ключа запроса
+ */
+template <typename T, typename Key = std::size_t, typename Hash = std::hash<Key>> class TaskManager {
+    using clock = std::chrono::steady_clock;
+
+  public:
+    using Result = typename Task<T>::Result;
+
+  private:
+    struct running {
+        task_ptr<T> task;
+        shared_future<T> run; // текущий запуск задачи. Не держатель: ожидающими считаются только выданные `Result`
+    };
+
+    struct cache_entry {
+        shared_future<T> value;
+        clock::time_point expires;
+        typename std::list<Key>::iterator position;
+    };
+
+    struct shard {
+        std::mutex mutex;
+        std::unordered_map<Key, running, Hash> in_flight;
+        std::unordered_map<Key, cache_entry, Hash> cache;
+        std::list<Key> lru; // в начале - последний запрошенный ключ
+
+        // готовый результат ключа, если он есть и не устарел. Отмечает ключ как запрошенный
+        const shared_future<T> *lookup(const Key &key) {
+            auto it = cache.find(key);
+            if (it == cache.end()) {
+                return nullptr;
+            }
+
+            if (it->second.expires <= clock::now()) {
+                lru.erase(it->second.position);
+                cache.erase(it);
+                return nullptr;
+            }
+
+            lru.splice(lru.begin(), lru, it->second.position);
+            return &it->second.value;
+        }
+
+        void store(const Key &key, const shared_future<T> &value, std::size_t capacity, clock::duration ttl) {
+            if (capacity == 0) {
+                return;
+            }
+
+            auto it = cache.find(key);
+            if (it != cache.end()) {
+                lru.erase(it->second.position);
+                cache.erase(it);
+            }
+
+            while (cache.size() >= capacity) {
+                cache.erase(lru.back());
+                lru.pop_back();
+            }
+
+            lru.push_front(key);
+            cache.emplace(key, cache_entry{value, clock::now() + ttl, lru.begin()});
+        }
+    };
+
+    struct state {
+        task_manager_options opts;
+        std::size_t shard_capacity;
+        std::vector<shard> shards;
+        Hash hash;
+
+        explicit state(task_manager_options opts) : opts(opts), shards(std::max<std::size_t>(opts.shards, 1)) {
+            shard_capacity = opts.capacity == 0 ? 0 : (opts.capacity + shards.size() - 1) / shards.size();
+        }
+
+        shard &shard_of(const Key &key) { return shards[hash(key) % shards.size()]; }
+
+        // вызывается, когда запуск задачи ключа завершился
+        void finish(const Key &key, const shared_future<T> &run) {
+            shard &s = shard_of(key);
+            std::lock_guard<std::mutex> lg{s.mutex};
+
+            auto it = s.in_flight.find(key);
+            // ключ мог уже перейти к новой задаче, если этот запуск был отменён
+            if (it == s.in_flight.end() || !same_run(it->second.run, run)) {
+                return;
+            }
+
+            if (run.status() == task_status::completed) {
+                s.store(key, run, shard_capacity, opts.ttl);
+            }
+            s.in_flight.erase(it);
+        }
+    };
+
+    std::shared_ptr<state> s;
+
+    static bool same_run(const shared_future<T> &a, const shared_future<T> &b) {
+        return detail::result_access::state(a) == detail::result_access::state(b);
+    }
+
+    // ставит запуск новой задачи ключа `key`, которую вызывающий поток добавил в `in_flight`
+    Result launch(shard &sh, const Key &key, const task_ptr<T> &task, std::shared_ptr<fine_grained_thread_pool> &pool) {
+        Result result;
+        try {
+            result = task->share(pool);
+        } catch (...) {
+            // запуск не поставлен: освобождаем ключ, иначе ждущие запросы его не дождутся
+            std::lock_guard<std::mutex> lg{sh.mutex};
+            auto it = sh.in_flight.find(key);
+            if (it != sh.in_flight.end() && it->second.task == task) {
+                sh.in_flight.erase(it);
+            }
+            throw;
+        }
+
+        shared_future<T> run = result.future();
+        {
+            std::lock_guard<std::mutex> lg{sh.mutex};
+            // до этой записи ключ занят только задачей: его запросы ждут, а не удаляют её
+            auto it = sh.in_flight.find(key);
+            if (it != sh.in_flight.end() && it->second.task == task) {
+                it->second.run = run;
+            }
+        }
+
+        // готовый запуск вызывает обработчик сразу, поэтому подписываемся вне блокировки сегмента
+        run.on_ready([weak = std::weak_ptr<state>(s), key](const shared_future<T> &run) {
+            if (auto alive = weak.lock()) {
+                alive->finish(key, run);
+            }
+        });
+
+        return result;
+    }
+
+    // к задаче ключа не удалось присоединиться. Если её запуск уже отменяется, ключ освобождается для новой задачи
+    // @return `false`, если нужно подождать: запуск ещё ставится либо вот-вот завершится
+    bool retire(shard &sh, const Key &key, const task_ptr<T> &task) {
+        std::lock_guard<std::mutex> lg{sh.mutex};
+
+        auto it = sh.in_flight.find(key);
+        if (it == sh.in_flight.end() || it->second.task != task) {
+            return true;
+        }
+
+        const shared_future<T> &run = it->second.run;
+        if (!run.valid()) {
+            return false;
+        }
+        if (run.is_ready()) {
+            return true;
+        }
+
+        auto run_state = detail::result_access::state(run);
+        if (run_state->stop_requested() || run_state->holders() == 0) {
+            // завершение отменённого запуска `finish` пропустит
+            sh.in_flight.erase(it);
+            return true;
+        }
+        return false;
+    }
+
+    template <typename F, typename Cond, typename Notice>
+    Result start(const Key &key, std::shared_ptr<fine_grained_thread_pool> &pool, F &&f, Cond &&c, Notice &&n) {
+        shard &sh = s->shard_of(key);
+
+        while (true) {
+            task_ptr<T> task;
+            bool owner = false;
+
+            {
+                std::lock_guard<std::mutex> lg{sh.mutex};
+
+                if (const shared_future<T> *hit = sh.lookup(key)) {
+                    return Result(*hit);
+                }
+
+                auto it = sh.in_flight.find(key);
+                if (it != sh.in_flight.end() && it->second.run.valid() && it->second.run.is_ready()) {
+                    // запуск уже завершён, но `finish` ещё не успел его разобрать
+                    shared_future<T> run = it->second.run;
+                    sh.in_flight.erase(it);
+                    it = sh.in_flight.end();
+
+                    if (run.status() == task_status::completed) {
+                        sh.store(key, run, s->shard_capacity, s->opts.ttl);
+                        return Result(run);
+                    }
+                }
+
+                if (it == sh.in_flight.end()) {
+                    // ключ занимает новая задача. Ставится она уже без блокировки сегмента
+                    task = make_task(std::forward<F>(f), std::forward<Cond>(c), std::forward<Notice>(n));
+                    sh.in_flight.emplace(key, running{task, {}});
+                    owner = true;
+                } else {
+                    task = it->second.task;
+                }
+            }
+
+            if (owner) {
+                return launch(sh, key, task, pool);
+            }
+
+            // задача ключа уже есть: присоединяемся к её запуску, тоже без блокировки сегмента
+            if (Result joined = task->join(); !joined.empty()) {
+                return joined;
+            }
+
+            if (!retire(sh, key, task)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+  public:
+    explicit TaskManager(task_manager_options opts = {}) : s(std::make_shared<state>(opts)) {}
+
+    TaskManager(const TaskManager &) = delete;
+    TaskManager &operator=(const TaskManager &) = delete;
+
+    /**
+     * @brief Возвращает результат задачи ключа `key`: готовый из кэша, текущего запуска, если задача ключа уже
+     * выполняется, либо нового запуска задачи `f` в пуле `pool`
+     * @param f Вызываемый объект, возвращающий `std::optional<T>` (либо просто `T`, если задача рассчитана на один
+     * подход). Используется, только если задача запускается этим вызовом
+     * @param c Условие досрочного завершения задачи
+     * @param n Обработчик завершения задачи
+     */
+    template <typename F, typename Cond, typename Notice>
+    Result add(const Key &key, std::shared_ptr<fine_grained_thread_pool> pool, F f, Cond c, Notice n) {
+        return start(key, pool, std::move(f), std::move(c), std::move(n));
+    }
+
+    template <typename F, typename Cond>
+    Result add(const Key &key, std::shared_ptr<fine_grained_thread_pool> pool, F f, Cond c) {
+        return start(key, pool, std::move(f), std::move(c), []() { return; });
+    }
+
+    template <typename F> Result add(const Key &key, std::shared_ptr<fine_grained_thread_pool> pool, F f) {
+        return start(key, pool, std::move(f), []() { return false; }, []() { return; });
+    }
+
+    /**
+     * @brief Результат ключа без запуска задачи: из кэша либо текущего запуска. Если ни того, ни другого нет (или
+     * запуск уже отменяется), возвращает пустой `Result`
+     */
+    Result find(const Key &key) {
+        shard &sh = s->shard_of(key);
+        task_ptr<T> task;
+
+        {
+            std::lock_guard<std::mutex> lg{sh.mutex};
+
+            if (const shared_future<T> *hit = sh.lookup(key)) {
+                return Result(*hit);
+            }
+
+            auto it = sh.in_flight.find(key);
+            if (it == sh.in_flight.end()) {
+                return Result{};
+            }
+
+            const shared_future<T> &run = it->second.run;
+            if (run.valid() && run.is_ready()) {
+                return run.status() == task_status::cancelled ? Result{} : Result(run);
+            }
+            task = it->second.task;
+        }
+
+        return task->join();
+    }
+
+    /**
+     * @brief Удаляет готовый результат ключа из кэша, следующий `add` запустит задачу заново. Выполняющийся запуск не
+     * отменяется
+     */
+    void invalidate(const Key &key) {
+        shard &sh = s->shard_of(key);
+        std::lock_guard<std::mutex> lg{sh.mutex};
+
+        auto it = sh.cache.find(key);
+        if (it != sh.cache.end()) {
+            sh.lru.erase(it->second.position);
+            sh.cache.erase(it);
+        }
+    }
+
+    /**
+     * @brief Очищает кэш готовых результатов
+     */
+    void clear() {
+        for (auto &sh : s->shards) {
+            std::lock_guard<std::mutex> lg{sh.mutex};
+            sh.cache.clear();
+            sh.lru.clear();
+        }
+    }
+
+    /**
+     * @brief Число готовых результатов в кэше (в том числе устаревших, но ещё не вытесненных)
+     */
+    std::size_t cached() const {
+        std::size_t total = 0;
+        for (auto &sh : s->shards) {
+            std::lock_guard<std::mutex> lg{sh.mutex};
+            total += sh.cache.size();
+        }
+        return total;
+    }
+
+    /**
+     * @brief Число ключей, задачи которых сейчас выполняются
+     */
+    std::size_t in_flight() const {
+        std::size_t total = 0;
+        for (auto &sh : s->shards) {
+            std::lock_guard<std::mutex> lg{sh.mutex};
+            total += sh.in_flight.size();
+        }
+        return total;
+    }
+};
+
+} // namespace stepwise
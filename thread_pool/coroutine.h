@@ -0,0 +1,283 @@
+#pragma once
+
+#include "fine_grained_thread_pool.h"
+#include "future.h"
+#include "../connection/IConnection.h"
+
+#if STEPWISE_HAS_COROUTINES
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace stepwise {
+
+namespace detail {
+
+/**
+ * @brief Общая часть `co_task<T>::promise_type`: пул, в котором выполняется корутина, и условие досрочного завершения
+ */
+struct co_promise_base {
+    fine_grained_thread_pool *pool = nullptr;
+    submit_options options{};
+    std::function<bool()> cancel_condition{};
+
+    virtual ~co_promise_base() = default;
+
+    // завершает результат отменой (`promise::set_cancelled`)
+    virtual void cancel() = 0;
+
+    bool should_cancel() const { return cancel_condition && cancel_condition(); }
+
+    /**
+     * @brief Продолжает корутину в текущем потоке либо, если выполнено условие досрочного завершения, записывает в
+     * результат `bad_value` и уничтожает корутину
+     */
+    void resume(std::coroutine_handle<> coroutine) {
+        if (should_cancel()) {
+            cancel();
+            coroutine.destroy();
+        } else {
+            coroutine.resume();
+        }
+    }
+
+    /**
+     * @brief Ставит продолжение корутины в пул. Это граница шага: между шагами пул выполняет другие задачи
+     */
+    void resume_on_pool(std::coroutine_handle<> coroutine) {
+        pool->submit(
+            [this, coroutine]() {
+                resume(coroutine);
+                return true;
+            },
+            options);
+    }
+};
+
+template <typename Promise> constexpr bool is_co_task_promise = std::is_base_of_v<co_promise_base, Promise>;
+
+/**
+ * @brief Ожидание `shared_future` без блокировки потока: корутина продолжится, когда результат будет готов
+ */
+template <typename T> struct future_awaiter {
+    shared_future<T> future;
+
+    bool await_ready() const { return future.is_ready(); }
+
+    template <typename Promise> void await_suspend(std::coroutine_handle<Promise> coroutine) {
+        future.on_ready([coroutine](const shared_future<T> &) {
+            // корутина `co_task` продолжается в своём пуле, а не в потоке, который записал результат
+            if constexpr (is_co_task_promise<Promise>) {
+                coroutine.promise().resume_on_pool(coroutine);
+            } else {
+                coroutine.resume();
+            }
+        });
+    }
+
+    const T &await_resume() const { return future.get(); }
+};
+
+/**
+ * @brief Ожидание данных из соединения без занятого потока: отправитель, поместивший данные, ставит продолжение
+ * корутины в пул (`IConnectionReceiver::notifyOnData`). Условие досрочного завершения корутины проверяется, когда
+ * приходят данные.
+ *
+ * Если соединение не умеет уведомлять, данные опрашивает пошаговая задача пула: каждый её шаг вызывает `receive()`,
+ * поэтому, пока корутина ждёт, она занимает поток пула так же, как любая задача, не завершившаяся за шаг
+ */
+template <typename T> struct receive_awaiter {
+    std::shared_ptr<IConnectionReceiver<T>> receiver;
+    std::shared_ptr<T> value{nullptr};
+    std::exception_ptr error{nullptr};
+
+    bool await_ready() {
+        try {
+            value = receiver->receive();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        return value || error;
+    }
+
+    template <typename Promise> void await_suspend(std::coroutine_handle<Promise> coroutine) {
+        static_assert(is_co_task_promise<Promise>, "stepwise::async_receive can only be awaited in stepwise::co_task");
+
+        if (!subscribe(coroutine)) {
+            poll(coroutine);
+        }
+    }
+
+    // продолжение корутины ставит в пул отправитель. Данные к этому времени может забрать другой получатель, тогда
+    // корутина подписывается снова
+    template <typename Promise> bool subscribe(std::coroutine_handle<Promise> coroutine) {
+        // если данные уже есть, корутина может продолжиться и завершиться до возврата из `notifyOnData`: получатель
+        // должен пережить вызов
+        auto rx = receiver;
+        return rx->notifyOnData([this, coroutine]() {
+            auto &promise = coroutine.promise();
+            promise.pool->submit(
+                [this, coroutine]() {
+                    if (await_ready() || coroutine.promise().should_cancel()) {
+                        coroutine.promise().resume(coroutine);
+                    } else if (!subscribe(coroutine)) {
+                        poll(coroutine);
+                    }
+                    return true;
+                },
+                promise.options);
+        });
+    }
+
+    template <typename Promise> void poll(std::coroutine_handle<Promise> coroutine) {
+        auto &promise = coroutine.promise();
+        promise.pool->submit(
+            [this, coroutine]() -> std::optional<bool> {
+                if (!await_ready() && !coroutine.promise().should_cancel()) {
+                    return {};
+                }
+                coroutine.promise().resume(coroutine);
+                return true;
+            },
+            promise.options);
+    }
+
+    std::shared_ptr<T> await_resume() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(value);
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief Пошаговая задача-корутина. Точки `co_await` - границы шагов: между ними пул выполняет другие задачи, а
+ * переход между шагами стоит переключения кадра корутины
+ *
+ * - Корутина не начинает выполняться до вызова `start`
+ *
+ * - `co_await stepwise::next_step()` возвращает корутину в очередь пула (аналог пустого `std::optional` у пошаговой
+ * задачи)
+ *
+ * - `co_await` на `shared_future`, `Task<T>::Result`, `shared_result<T>` не блокирует поток: корутина продолжится в
+ * пуле, когда результат будет готов. `co_await stepwise::async_receive(receiver)` ждёт данных из соединения
+ *
+ * - `co_return value` записывает результат
+ * @code
+ * stepwise::co_task<int> sum(rx_connection_ptr<int> rx) {
+ *     int sum = 0;
+ *     for (int i = 0; i < 10; ++i) {
+ *         sum += *co_await stepwise::async_receive(rx);
+ *     }
+ *     co_return sum;
+ * }
+ *
+ * auto result = sum(rx).start(pool);
+ * @endcode
+ */
+template <typename T> class co_task {
+  public:
+    struct promise_type : detail::co_promise_base {
+        promise<T> result;
+
+        co_task get_return_object() { return co_task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        // кадр корутины освобождается сразу после `co_return`
+        std::suspend_never final_suspend() noexcept { return {}; }
+
+        void return_value(T value) { result.set_value(std::move(value)); }
+
+        void unhandled_exception() { result.set_exception(std::current_exception()); }
+
+        void cancel() override { result.set_cancelled(); }
+    };
+
+  private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit co_task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+  public:
+    co_task(co_task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+    co_task &operator=(co_task &&other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    co_task(const co_task &) = delete;
+    co_task &operator=(const co_task &) = delete;
+
+    ~co_task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    /**
+     * @brief Ставит первый шаг корутины в пул `pool`. Пул должен жить, пока корутина не завершится
+     * @param cond Условие досрочного завершения, проверяется перед каждым шагом. Если оно `true`, корутина
+     * уничтожается, а в результате окажется `stepwise::bad_value`
+     * @return `stepwise::future<T>` результата корутины
+     */
+    future<T> start(fine_grained_thread_pool &pool, std::function<bool()> cond, submit_options opts = {}) && {
+        auto coroutine = std::exchange(handle, nullptr);
+        auto &promise = coroutine.promise();
+
+        promise.pool = &pool;
+        promise.options = opts;
+        promise.cancel_condition = std::move(cond);
+
+        future<T> result = promise.result.get_future();
+        promise.resume_on_pool(coroutine);
+        return result;
+    }
+
+    future<T> start(fine_grained_thread_pool &pool, submit_options opts = {}) && {
+        return std::move(*this).start(pool, nullptr, opts);
+    }
+};
+
+/**
+ * @brief `co_await stepwise::next_step()` завершает текущий шаг `co_task`: корутина возвращается в очередь пула
+ */
+struct next_step {
+    bool await_ready() const noexcept { return false; }
+
+    template <typename Promise> void await_suspend(std::coroutine_handle<Promise> coroutine) {
+        static_assert(detail::is_co_task_promise<Promise>,
+                      "stepwise::next_step can only be awaited in stepwise::co_task");
+        coroutine.promise().resume_on_pool(coroutine);
+    }
+
+    void await_resume() const noexcept {}
+};
+
+/**
+ * @brief `co_await stepwise::async_receive(receiver)` - следующая порция данных из соединения
+ * @throw `std::logic_error`, если отправитель закрыт и данных больше не будет
+ */
+template <typename T> detail::receive_awaiter<T> async_receive(std::shared_ptr<IConnectionReceiver<T>> receiver) {
+    return detail::receive_awaiter<T>{std::move(receiver)};
+}
+
+template <typename T> detail::future_awaiter<T> operator co_await(const shared_future<T> &future) {
+    return detail::future_awaiter<T>{future};
+}
+
+} // namespace stepwise
+
+#endif
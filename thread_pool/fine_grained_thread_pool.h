@@ -1,11 +1,32 @@
 #pragma once
 
 #include "stepwise_function_wrapper.h"
+#include "pool_options.h"
+#include "numa_topology.h"
+#include "pool_metrics.h"
+#include "trace.h"
 #include "../safe_queue/threadsafe_queue.h"
+#include "../safe_queue/priority_queue.h"
+#include "../safe_queue/fair_queue.h"
 
 #include <atomic>
-#include <future>
+#include <chrono>
+#include <condition_variable>
+#include <iterator>
+#include <mutex>
 #include <optional>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// `co_await pool.schedule()` и `thread_pool/coroutine.h` доступны при сборке в режиме C++20
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+#include <coroutine>
+#define STEPWISE_HAS_COROUTINES 1
+#else
+#define STEPWISE_HAS_COROUTINES 0
+#endif
 
 class fine_grained_thread_pool {
 
@@ -24,48 +45,530 @@ class fine_grained_thread_pool {
         }
 
         std::vector<std::thread> *operator->() { return &threads_; }
+        const std::vector<std::thread> *operator->() const { return &threads_; }
         // объект joiner должен разрушаться строго после разрушения вектора потоков. Поэтому решено поместить вектор
         // потоков в joiner, для снижения требований к клиентскому коду
     };
 
+    struct worker_context : stepwise::wait_helper {
+        fine_grained_thread_pool *pool;
+        unsigned index;
+        unsigned node;
+        unsigned turn = 0; // источник, с которого `next_task` начнёт поиск: закреплённые, локальные или общие задачи
+        unsigned help_depth = 0; // сколько шагов, выполняемых в ожидании (`help`), сейчас вложено друг в друга
+        // время шагов, выполненных в ожидании внутри текущего шага. Вычитается из его длительности в метриках и учёте
+        // групп: вложенные шаги учитываются сами
+        std::chrono::nanoseconds nested{0};
+
+        worker_context(fine_grained_thread_pool *pool, unsigned index, unsigned node)
+            : pool(pool), index(index), node(node) {}
+
+        // ожидание результата в потоке пула выполняет шаги из очереди его узла
+        bool help() override { return pool->help(*this); }
+    };
+
+    // поток пула, в котором выполняется код, либо `nullptr`, если поток не принадлежит ни одному пулу
+    static inline thread_local const worker_context *this_worker = nullptr;
+
+    using task_queue = threadsafe_queue<stepwise_function_wrapper>;
+
+    struct earlier_deadline {
+        bool operator()(const stepwise_function_wrapper &a, const stepwise_function_wrapper &b) const {
+            return a.deadline() < b.deadline();
+        }
+    };
+
+    // очередь режима `scheduling::earliest_deadline`
+    using deadline_queue = threadsafe_priority_queue<stepwise_function_wrapper, earlier_deadline>;
+
+    struct group_share {
+        const fine_grained_thread_pool *pool;
+
+        std::size_t count() const { return pool->groups.size(); }
+        std::size_t group_of(const stepwise_function_wrapper &task) const { return task.group(); }
+        double virtual_time(std::size_t group) const { return pool->groups[group]->virtual_time(); }
+    };
+
+    // очередь режима `scheduling::fair_share`
+    using fair_queue = threadsafe_fair_queue<stepwise_function_wrapper, group_share>;
+
+    // очереди одного потока для задач с привязкой (`submit_options::affinity`). Счётчики позволяют не захватывать
+    // блокировку пустой очереди
+    struct local_queues {
+        unsigned node;
+
+        task_queue pinned; // `affinity::hard`, другие потоки их не берут
+        std::atomic<std::size_t> pinned_count{0};
+
+        task_queue sticky; // `affinity::soft`, последний шаг выполнил этот поток
+        std::atomic<std::size_t> sticky_count{0};
+
+        explicit local_queues(unsigned node) : node(node) {}
+    };
+
     std::atomic_bool isWorking{true};
-    threadsafe_queue<stepwise_function_wrapper> tasks;
+    // потоки не берут задачи, пока `start` не закрепит их все за процессорами: иначе первые шаги выполнятся не на
+    // своём узле
+    std::mutex start_mut;
+    std::condition_variable start_cv;
+    bool threads_released{false};
+    // по одной очереди на подпул (NUMA-узел). Вектор заполняется до запуска потоков и больше не меняется
+    std::vector<std::unique_ptr<task_queue>> tasks;
+    std::atomic_uint next_node{0};
+    // счётчики потоков, по одному на поток. Вектор заполняется до запуска потоков и больше не меняется
+    std::vector<std::unique_ptr<stepwise::worker_metrics>> workers;
+    // учёт времени шагов по группам задач, хотя бы одна группа. Вектор заполняется до запуска потоков
+    std::vector<std::unique_ptr<stepwise::group_account>> groups;
+    bool groups_accounted{false};
+    // локальные очереди, по одной паре на поток. Вектор заполняется до запуска потоков и больше не меняется
+    std::vector<std::unique_ptr<local_queues>> local;
+    // ставилась ли хоть одна задача с привязкой. Пока нет, потоки не проверяют локальные очереди
+    std::atomic_bool affinity_used{false};
+    // `pool_options::max_help_depth`: сколько шагов поток выполняет вложенно, пока ждёт результат
+    unsigned max_help_depth{16};
+#if STEPWISE_POOL_METRICS
+    std::atomic<std::uint64_t> tasks_submitted{0};
+#endif
+    // номер пула в трассе (`pid` в Chrome trace)
+    const std::uint32_t trace_pool_id{stepwise::tracer::next_pool_id()};
     join_threads joiner{};
 
   private:
-    void working_thread() {
+    void working_thread(unsigned index, unsigned node) {
+        {
+            std::unique_lock<std::mutex> lk{start_mut};
+            start_cv.wait(lk, [this]() { return threads_released; });
+        }
+
+        worker_context context{this, index, node};
+        this_worker = &context;
+        stepwise::wait_helper::current = &context;
+
+        task_queue &queue = *tasks[node];
+
+        auto idle_from = workers[index]->now();
         while (isWorking) {
-            auto task = tasks.wait_and_pop();
+            // номер пробуждения берётся до проверки локальных очередей: задача, поставленная в них после проверки,
+            // прервёт ожидание
+            auto seen = queue.wakeups_seen();
 
+            auto task = next_task(context);
             if (!task) {
-                break;
+                task = queue.wait_and_pop(seen);
             }
 
-            task->step();
-            if (!task->is_done()) {
-                tasks.push(task);
+            if (!task) {
+                continue; // остановка пула либо задача в локальной очереди
             }
+
+            run_step(context, task, idle_from);
         }
+
+        stepwise::wait_helper::current = nullptr;
+        this_worker = nullptr;
     }
 
-  public:
-    fine_grained_thread_pool(unsigned number_of_threads = 0) {
-        try {
-            if (number_of_threads == 0) {
-                number_of_threads = std::thread::hardware_concurrency();
+    // выполняет шаг задачи `task` и возвращает её в очередь, если она не завершена
+    void run_step(worker_context &context, std::shared_ptr<stepwise_function_wrapper> &task,
+                  stepwise::metrics_clock::time_point &idle_from) {
+        unsigned index = context.index;
+        stepwise::worker_metrics &metrics = *workers[index];
+
+        bool traced = stepwise::tracer::enabled();
+
+        if (!task->claim()) {
+            // надгробие: задачу отменили, пока она ждала в очереди, шаг не нужен
+            if (traced) {
+                trace(stepwise::tracer::event_type::complete, (int) index, *task);
             }
+            metrics.record_finish(task->metrics(), stepwise::task_status::cancelled);
+            return;
+        }
+
+        if (traced) {
+            trace(stepwise::tracer::event_type::step_begin, (int) index, *task);
+        }
+
+        auto begin = metrics.now();
+        metrics.record_idle(idle_from, begin);
+
+        std::chrono::steady_clock::time_point group_begin{};
+        if (groups_accounted) {
+            group_begin = std::chrono::steady_clock::now();
+        }
+
+        auto enclosing_nested = std::exchange(context.nested, std::chrono::nanoseconds::zero());
+
+        task->step();
+        bool done = task->release(task->is_done());
+
+        auto nested = std::exchange(context.nested, enclosing_nested);
+
+        if (groups_accounted) {
+            groups[task->group()]->record_step(std::chrono::steady_clock::now() - group_begin - nested);
+        }
+
+        idle_from = metrics.now();
+        metrics.record_step(task->metrics(), begin, idle_from, nested);
+
+        if (traced) {
+            trace(stepwise::tracer::event_type::step_end, (int) index, *task);
+            if (done) {
+                trace(stepwise::tracer::event_type::complete, (int) index, *task);
+            }
+        }
+
+        if (!done) {
+            requeue(context, task);
+        } else {
+            metrics.record_finish(task->metrics(), task->status());
+            metrics.record_deadline(task->deadline(), idle_from);
+        }
+    }
+
+    /**
+     * @brief Выполняет один шаг из очереди узла потока `context`, не блокируясь. Вызывается, когда задача в этом
+     * потоке ждёт результат. Шаг, выполненный здесь, лежит на стеке ждущего, поэтому вложенность ограничена
+     * `pool_options::max_help_depth`: глубже поток не помогает, а ждёт, пока результат посчитают другие потоки
+     * @return `false`, если очередь пуста либо вложенных ожиданий уже `max_help_depth`
+     */
+    bool help(worker_context &context) {
+        if (context.help_depth >= max_help_depth) {
+            return false;
+        }
+
+        auto task = next_task(context);
+        if (!task) {
+            return false;
+        }
+
+        auto from = std::chrono::steady_clock::now();
+        auto idle_from = from;
+
+        ++context.help_depth;
+        run_step(context, task, idle_from);
+        --context.help_depth;
+
+        context.nested += std::chrono::steady_clock::now() - from;
+        return true;
+    }
+
+    static std::shared_ptr<stepwise_function_wrapper> pop_local(task_queue &queue, std::atomic<std::size_t> &count) {
+        if (count.load(std::memory_order_acquire) == 0) {
+            return nullptr;
+        }
+
+        auto task = queue.try_pop();
+        if (task) {
+            count.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    static void push_local(task_queue &queue, std::atomic<std::size_t> &count,
+                           std::shared_ptr<stepwise_function_wrapper> &task) {
+        queue.push(task);
+        count.fetch_add(1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Следующая задача для потока `context`, без ожидания: из его локальных очередей и очереди подпула по
+     * кругу, чтобы ни один источник не вытеснял остальные, а если они пусты - задача `affinity::soft` другого потока
+     * того же подпула
+     */
+    std::shared_ptr<stepwise_function_wrapper> next_task(worker_context &context) {
+        task_queue &shared = *tasks[context.node];
+        if (!affinity_used.load(std::memory_order_acquire)) {
+            return shared.try_pop();
+        }
+
+        local_queues &own = *local[context.index];
+        for (unsigned i = 0; i < 3; ++i) {
+            unsigned source = (context.turn + i) % 3;
+
+            std::shared_ptr<stepwise_function_wrapper> task;
+            if (source == 0) {
+                task = pop_local(own.pinned, own.pinned_count);
+            } else if (source == 1) {
+                task = pop_local(own.sticky, own.sticky_count);
+            } else {
+                task = shared.try_pop();
+            }
+
+            if (task) {
+                context.turn = source + 1;
+                return task;
+            }
+        }
+
+        for (std::size_t i = 1; i < local.size(); ++i) {
+            local_queues &other = *local[(context.index + i) % local.size()];
+            if (other.node != context.node) {
+                continue;
+            }
+
+            auto task = pop_local(other.sticky, other.sticky_count);
+            if (task) {
+                return task;
+            }
+        }
+
+        return nullptr;
+    }
+
+    // возвращает в очередь задачу, шаг которой выполнил поток `context`
+    void requeue(worker_context &context, std::shared_ptr<stepwise_function_wrapper> &task) {
+        switch (task->affinity()) {
+        case stepwise::affinity::hard:
+            enqueue_pinned(task);
+            break;
+
+        case stepwise::affinity::soft: {
+            task->set_affinity(stepwise::affinity::soft, context.index);
+
+            local_queues &own = *local[context.index];
+            push_local(own.sticky, own.sticky_count, task);
+
+            // у потока накопилось больше одной задачи, простаивающие потоки подпула могут забрать лишние
+            task_queue &shared = *tasks[context.node];
+            if (own.sticky_count.load(std::memory_order_relaxed) > 1 && shared.has_waiters()) {
+                shared.wake_waiters();
+            }
+            break;
+        }
+
+        default:
+            tasks[context.node]->push(task);
+        }
+    }
+
+    void enqueue_pinned(std::shared_ptr<stepwise_function_wrapper> &task) {
+        local_queues &owner = *local[task->worker()];
+        push_local(owner.pinned, owner.pinned_count, task);
+
+        if (!(this_worker && this_worker->pool == this && this_worker->index == task->worker())) {
+            tasks[owner.node]->wake_waiters();
+        }
+    }
+
+    // ставит в очередь задачу, прошедшую `announce`
+    void enqueue(std::shared_ptr<stepwise_function_wrapper> &task, const stepwise::submit_options &opts) {
+        if (task->affinity() == stepwise::affinity::hard) {
+            enqueue_pinned(task);
+        } else {
+            queue_for(opts).push(task);
+        }
+    }
+
+    void trace(stepwise::tracer::event_type type, int worker, stepwise_function_wrapper &task) {
+        auto &info = task.trace();
+        if (info.id == 0) { // задача поставлена до включения трассировки
+            info.id = stepwise::tracer::next_task_id();
+        }
+
+        stepwise::tracer::record(type, trace_pool_id, worker, info);
+    }
+
+    // учёт постановки задачи в метриках и трассе
+    void announce(stepwise_function_wrapper &task, const stepwise::submit_options &opts) {
+        task.metrics().on_submit();
+#if STEPWISE_POOL_METRICS
+        tasks_submitted.fetch_add(1, std::memory_order_relaxed);
+#endif
+
+        task.trace().name = opts.name;
+        if (opts.stop.stop_possible()) {
+            task.set_stop_token(opts.stop);
+        }
+        task.set_deadline(opts.deadline);
+        task.set_group(opts.group % (unsigned) groups.size());
 
-            for (unsigned i = 0; i < number_of_threads; ++i) {
-                joiner->push_back(std::thread(&fine_grained_thread_pool::working_thread, this));
+        if (opts.affinity != stepwise::affinity::none) {
+            // до постановки в очередь: поток, увидевший задачу, увидит и флаг
+            if (!affinity_used.load(std::memory_order_relaxed)) {
+                affinity_used.store(true, std::memory_order_release);
+            }
+            task.set_affinity(opts.affinity, (unsigned) (opts.affinity_key % local.size()));
+        }
+        if (stepwise::tracer::enabled()) {
+            trace(stepwise::tracer::event_type::submit,
+                  (this_worker && this_worker->pool == this) ? (int) this_worker->index : -1, task);
+        }
+    }
+
+    task_queue &queue_for(const stepwise::submit_options &opts) {
+        if (opts.node >= 0) {
+            return *tasks[opts.node % tasks.size()];
+        }
+
+        if (this_worker && this_worker->pool == this) {
+            return *tasks[this_worker->node];
+        }
+
+        return *tasks[next_node.fetch_add(1, std::memory_order_relaxed) % tasks.size()];
+    }
+
+    void start(const stepwise::pool_options &options) {
+        struct node_plan {
+            unsigned threads;
+            std::vector<std::vector<int>> cpu_sets;
+        };
+
+        std::vector<node_plan> plan;
+
+        for (unsigned group = 0; group < options.group_weights.size(); ++group) {
+            groups.push_back(std::make_unique<stepwise::group_account>(group, options.group_weights[group]));
+        }
+        if (groups.empty()) {
+            groups.push_back(std::make_unique<stepwise::group_account>(0, 1));
+        }
+        groups_accounted = !options.group_weights.empty();
+        max_help_depth = options.max_help_depth;
+
+        if (options.numa_aware) {
+            auto nodes = stepwise::numa_topology();
+            unsigned total = options.number_of_threads;
+
+            for (std::size_t i = 0; i < nodes.size(); ++i) {
+                unsigned threads = (total == 0) ? (unsigned) nodes[i].cpus.size()
+                                                : total / (unsigned) nodes.size() + (i < total % nodes.size() ? 1 : 0);
+                // каждый узел получает хотя бы один поток, иначе задачи с подсказкой этого узла не выполнятся
+                plan.push_back({threads ? threads : 1, {nodes[i].cpus}});
+            }
+        } else {
+            unsigned threads = options.number_of_threads;
+            if (threads == 0) {
+                threads = std::thread::hardware_concurrency();
+            }
+            plan.push_back({threads, options.cpu_sets});
+        }
+
+        for (unsigned node = 0, index = 0; node < plan.size(); ++node) {
+            if (options.order == stepwise::scheduling::earliest_deadline) {
+                tasks.push_back(std::make_unique<deadline_queue>());
+            } else if (options.order == stepwise::scheduling::fair_share) {
+                tasks.push_back(std::make_unique<fair_queue>(group_share{this}));
+            } else {
+                tasks.push_back(std::make_unique<task_queue>());
+            }
+            for (unsigned i = 0; i < plan[node].threads; ++i, ++index) {
+                workers.push_back(std::make_unique<stepwise::worker_metrics>(index, node));
+                local.push_back(std::make_unique<local_queues>(node));
+            }
+        }
+
+        try {
+            unsigned index = 0;
+            for (unsigned node = 0; node < plan.size(); ++node) {
+                auto &[threads, cpu_sets] = plan[node];
+
+                for (unsigned i = 0; i < threads; ++i, ++index) {
+                    joiner->push_back(std::thread(&fine_grained_thread_pool::working_thread, this, index, node));
+
+                    if (!cpu_sets.empty()) {
+                        int err = stepwise::pin_thread(joiner->back(), cpu_sets[i % cpu_sets.size()]);
+                        if (err != 0) {
+                            throw std::system_error(err, std::generic_category(),
+                                                    "fine_grained_thread_pool: unable to pin worker thread");
+                        }
+                    }
+                }
             }
         } catch (...) {
-            isWorking = false;
+            stop();
             throw;
         }
+
+        release_threads();
     }
-    ~fine_grained_thread_pool() {
+
+    void release_threads() {
+        {
+            std::lock_guard<std::mutex> lg{start_mut};
+            threads_released = true;
+        }
+        start_cv.notify_all();
+    }
+
+    void stop() {
         isWorking = false;
-        tasks.disable_wait_and_pop();
+        for (auto &queue : tasks) {
+            queue->disable_wait_and_pop();
+        }
+        release_threads();
+    }
+
+  public:
+    fine_grained_thread_pool(unsigned number_of_threads = 0) {
+        stepwise::pool_options options;
+        options.number_of_threads = number_of_threads;
+        start(options);
+    }
+
+    /**
+     * @brief Создаёт пул с заданными параметрами размещения потоков
+     *
+     * - Если задан `options.cpu_sets`, потоки закрепляются за указанными процессорами
+     *
+     * - Если `options.numa_aware == true`, на каждый NUMA-узел создаётся подпул со своей очередью задач. Потоки
+     * подпула закреплены за процессорами узла, а шаг задачи, возвращённой в очередь, выполняется только потоками того
+     * же узла
+     *
+     * - `options.order` задаёт порядок шагов: по кругу, по ближайшему сроку (`submit_options::deadline`) либо по
+     * справедливому разделению времени между группами задач (`options.group_weights`, `submit_options::group`)
+     *
+     * - `options.max_help_depth` ограничивает вложенность шагов, которые поток выполняет, пока ждёт результат
+     * @throw `std::system_error`, если поток не удалось закрепить за процессорами
+     */
+    explicit fine_grained_thread_pool(const stepwise::pool_options &options) { start(options); }
+
+    ~fine_grained_thread_pool() { stop(); }
+
+    /**
+     * @brief Количество потоков пула
+     */
+    unsigned threads_count() const { return (unsigned) joiner->size(); }
+
+    /**
+     * @brief Количество подпулов (NUMA-узлов). Без `numa_aware` всегда `1`
+     */
+    unsigned nodes_count() const { return (unsigned) tasks.size(); }
+
+    /**
+     * @brief Номер подпула, в котором работает вызывающий поток, либо `-1`, если поток не принадлежит пулу
+     */
+    int current_node() const { return (this_worker && this_worker->pool == this) ? (int) this_worker->node : -1; }
+
+    /**
+     * @brief Собирает снимок метрик пула: длины очередей, счётчики и гистограммы потоков. Счётчики потоков читаются
+     * без блокировок, поэтому снимок может быть не согласован между потоками в пределах нескольких шагов. Если
+     * метрики отключены (`STEPWISE_POOL_METRICS 0`), заполняются только длины очередей и время групп задач
+     */
+    stepwise::pool_metrics_snapshot metrics() const {
+        stepwise::pool_metrics_snapshot snapshot;
+
+        for (auto &queue : tasks) {
+            snapshot.queue_depth.push_back(queue->size());
+        }
+        for (auto &queues : local) {
+            snapshot.queue_depth[queues->node] += queues->pinned_count + queues->sticky_count;
+        }
+
+        for (auto &worker : workers) {
+            worker->add_to(snapshot);
+        }
+
+        if (groups_accounted) {
+            for (auto &group : groups) {
+                group->add_to(snapshot);
+            }
+        }
+
+#if STEPWISE_POOL_METRICS
+        snapshot.tasks_submitted = tasks_submitted.load(std::memory_order_relaxed);
+#endif
+
+        return snapshot;
     }
 
     /**
@@ -85,23 +588,91 @@ class fine_grained_thread_pool {
      * задача рассчитана на один подход)  - задача для пула потоков
      * @param cond Вызываемый объект, возвращающий `bool` - условие досрочного завершения задачи
      * @param n Вызываемый объект, обработчик завершения задачи
-     * @return Объект `std::future<возвращаемый тип>`, связанный с задачей `f`. Когда задача будет выполнена, в этом
-     * объекте появится результат её выполнения
+     * @return Объект `stepwise::future<возвращаемый тип>`, связанный с задачей `f`. Когда задача будет выполнена, в
+     * этом объекте появится результат её выполнения
      */
     template <typename Callable, typename BoolFunc, typename Notice>
     auto submit(Callable &&f, BoolFunc &&cond, Notice &&n) {
+        return submit(f, cond, n, stepwise::submit_options{});
+    }
+
+    /**
+     * @brief То же, что `submit(f, cond, n)`, с параметрами постановки `opts`, например подсказкой NUMA-узла
+     */
+    template <typename Callable, typename BoolFunc, typename Notice>
+    auto submit(Callable &&f, BoolFunc &&cond, Notice &&n, stepwise::submit_options opts) {
         auto wrapped_task = stepwise_function_wrapper::wrap(std::move(f), std::move(cond), std::move(n));
-        return submit(wrapped_task);
+        return submit(wrapped_task, opts);
+    }
+
+    template <typename Callable, typename BoolFunc>
+    auto submit(Callable &&f, BoolFunc &&cond, stepwise::submit_options opts) {
+        return submit(f, cond, []() { return; }, opts);
+    }
+
+    template <typename Callable> auto submit(Callable &&f, stepwise::submit_options opts) {
+        return submit(f, []() { return false; }, opts);
+    }
+
+    /**
+     * @brief Ставит задачу `f`, результат которой записывается в уже существующий `promise`. Используется
+     * продолжениями (`shared_future::then`), которые отдают свой результат до того, как задача попадёт в пул
+     */
+    template <typename ResultType, typename Callable>
+    void submit_with_promise(stepwise::promise<ResultType> promise, Callable &&f,
+                             stepwise::submit_options opts = stepwise::submit_options{}) {
+        auto task = stepwise_function_wrapper::wrap_with_promise(std::move(promise), std::move(f),
+                                                                 []() { return false; }, []() { return; });
+        wrapped_function<ResultType> wrapped_task(task, stepwise::future<ResultType>{});
+        submit(wrapped_task, opts);
     }
 
     template <typename ResultType> auto submit(wrapped_function<ResultType> &wrapped_task) {
+        return submit(wrapped_task, stepwise::submit_options{});
+    }
+
+    template <typename ResultType>
+    auto submit(wrapped_function<ResultType> &wrapped_task, stepwise::submit_options opts) {
         auto &[task, future] = wrapped_task;
 
-        tasks.push(task);
+        announce(*task, opts);
+        enqueue(task, opts);
 
         return std::move(future);
     }
 
+    /**
+     * @brief Помещает в очередь сразу несколько задач: все задачи попадают в очередь за один захват блокировки, и
+     * будится не больше потоков, чем поставлено задач
+     * @param functions Диапазон вызываемых объектов одного типа, как у `submit(f)`. Объекты перемещаются из диапазона
+     * @return `std::vector<stepwise::future<возвращаемый тип>>` в порядке `functions`
+     */
+    template <typename Range> auto submit_bulk(Range &&functions, stepwise::submit_options opts = {}) {
+        using callable = std::decay_t<decltype(*std::begin(functions))>;
+        using value_type = typename stepwise_function_wrapper::value_of<callable>::type;
+
+        std::vector<stepwise::future<value_type>> futures;
+        std::vector<std::shared_ptr<stepwise_function_wrapper>> batch;
+
+        for (auto &f : functions) {
+            auto wrapped = stepwise_function_wrapper::wrap(std::move(f), []() { return false; }, []() { return; });
+
+            announce(*wrapped.function, opts);
+            batch.push_back(std::move(wrapped.function));
+            futures.push_back(std::move(wrapped.future));
+        }
+
+        if (opts.affinity == stepwise::affinity::hard) {
+            for (auto &task : batch) {
+                enqueue_pinned(task);
+            }
+        } else {
+            queue_for(opts).push_bulk(batch);
+        }
+
+        return futures;
+    }
+
     /**
      * @brief
      * - Помещает вызываемый объект `f` в очередь. Когда очередь дойдёт до `f`, один поток из пула примется за
@@ -116,8 +687,8 @@ class fine_grained_thread_pool {
      * @param f Вызываемый объект, возвращающий `std::optional<возвращаемый тип>` (либо просто `возвращаемый тип`, если
      * задача рассчитана на один подход) - задача для пула потоков
      * @param cond Вызываемый объект, возвращающий `bool` - условие досрочного завершения задачи
-     * @return Объект `std::future<возвращаемый тип>`, связанный с задачей `f`. Когда задача будет выполнена, в этом
-     * объекте появится результат её выполнения
+     * @return Объект `stepwise::future<возвращаемый тип>`, связанный с задачей `f`. Когда задача будет выполнена, в
+     * этом объекте появится результат её выполнения
      */
     template <typename BoolFunc, typename Callable> auto submit(Callable &&f, BoolFunc &&cond) {
         return submit(f, cond, []() { return; });
@@ -127,10 +698,35 @@ class fine_grained_thread_pool {
      * @brief Помещает вызываемый объект `f` в очередь. Когда очередь дойдёт до `f`, один поток из пула примется за
      * выполнение `f()` до её завершения
      * @param f Вызываемый объект, задача для пула потоков
-     * @return Объект `std::future`, связанный с задачей `f`. Когда задача будет выполнена, в этом объекте появится
+     * @return Объект `stepwise::future`, связанный с задачей `f`. Когда задача будет выполнена, в этом объекте появится
      * результат её выполнения
      */
     template <typename Callable> auto submit(Callable &&f) {
         return submit(f, []() { return false; });
     }
+
+#if STEPWISE_HAS_COROUTINES
+    struct schedule_awaiter {
+        fine_grained_thread_pool *pool;
+        stepwise::submit_options opts;
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> coroutine) {
+            pool->submit(
+                [coroutine]() {
+                    coroutine.resume();
+                    return true;
+                },
+                opts);
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    /**
+     * @brief `co_await pool.schedule()` приостанавливает корутину и продолжает её в потоке пула
+     */
+    schedule_awaiter schedule(stepwise::submit_options opts = {}) { return {this, opts}; }
+#endif
 };
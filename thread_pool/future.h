@@ -0,0 +1,925 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "stop_token.h"
+#include "task_status.h"
+
+namespace stepwise {
+
+/**
+ * @brief Исключение, которое `get()` выбрасывает для результата отменённой задачи: значение так и не было получено
+ */
+class bad_value : public std::exception {
+    std::string msg;
+
+  public:
+    bad_value(const std::string &message) : msg(message) {}
+    const char *what() const noexcept override { return msg.c_str(); }
+};
+
+/**
+ * @brief Ожидание изменения 32-битного слова. На Linux - системный вызов futex, на остальных платформах - опрос с
+ * уступкой процессора
+ * @param timeout Максимальное время ожидания, `nullptr` - без ограничения
+ */
+inline void futex_wait(std::atomic<std::uint32_t> &word, std::uint32_t expected,
+                       const std::chrono::nanoseconds *timeout = nullptr) {
+#ifdef __linux__
+    timespec ts{};
+    if (timeout) {
+        ts.tv_sec = (time_t) (timeout->count() / 1000000000);
+        ts.tv_nsec = (long) (timeout->count() % 1000000000);
+    }
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAIT_PRIVATE, expected,
+            timeout ? &ts : nullptr, nullptr, 0);
+#else
+    auto until = std::chrono::steady_clock::now() + (timeout ? *timeout : std::chrono::nanoseconds::max() / 2);
+    while (word.load(std::memory_order_acquire) == expected && std::chrono::steady_clock::now() < until) {
+        std::this_thread::yield();
+    }
+#endif
+}
+
+/**
+ * @brief Будит все потоки, ожидающие изменения слова в `futex_wait`
+ */
+inline void futex_wake_all(std::atomic<std::uint32_t> &word) {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+    (void) word;
+#endif
+}
+
+/**
+ * @brief Чем занять поток, пока он ждёт результат. Пул устанавливает его своим потокам (`wait_helper::current`): если
+ * задача в пуле ждёт результат другой задачи, поток выполняет шаги из очереди пула, а не блокируется
+ */
+struct wait_helper {
+    static inline thread_local wait_helper *current = nullptr;
+
+    // выполняет один шаг из очереди; `false`, если очередь пуста либо вложенных ожиданий уже слишком много
+    virtual bool help() = 0;
+
+  protected:
+    ~wait_helper() = default;
+};
+
+/**
+ * @brief Общее состояние `promise`/`future`: одно выделение памяти, в котором лежат слово состояния, счётчик ссылок и
+ * сам результат
+ *
+ * - Служит и блоком управления `Task<T>::Result`: в том же слове, что и ссылки, считаются держатели результата, а
+ * последний ушедший держатель отменяет задачу через сохранённый здесь `stop_source`
+ *
+ * - Готовность проверяется одной атомарной загрузкой
+ *
+ * - Ожидающие потоки спят на слове состояния (futex), системный вызов пробуждения делается только если кто-то ждёт
+ */
+template <typename T> class result_state {
+  public:
+    static constexpr std::uint32_t pending = 0;
+    static constexpr std::uint32_t has_value = 1;
+    static constexpr std::uint32_t has_exception = 2;
+    static constexpr std::uint32_t has_waiters = 4;
+    static constexpr std::uint32_t cancelled = 8; // задача отменена, ни значения, ни исключения нет
+    static constexpr std::uint32_t ready_mask = has_value | has_exception | cancelled;
+
+    /**
+     * @brief Обработчик готовности результата. Узел интрузивного списка, который добавляется без блокировок
+     */
+    struct callback {
+        callback *next{nullptr};
+
+        virtual ~callback() = default;
+        virtual void invoke(result_state &state) = 0;
+    };
+
+  private:
+    template <typename F> struct callback_impl : callback {
+        F f;
+
+        callback_impl(F &&f) : f(std::move(f)) {}
+        void invoke(result_state &state) override { f(state); }
+    };
+
+    // ссылку держателя отпускают вместе с признаком держателя, одной операцией
+    static constexpr std::uint64_t holder = std::uint64_t(1) << 32;
+    static constexpr std::uint64_t references_mask = holder - 1;
+
+    std::atomic<std::uint32_t> state{pending};
+    // младшие 32 бита - ссылки на состояние, старшие - сколько из них принадлежит держателям результата
+    std::atomic<std::uint64_t> references{1};
+
+    // отмена задачи, которая пишет результат. Запрашивается, когда уходит последний держатель
+    stop_source stop{nostopstate};
+
+    // задача в очереди пула, которую запрос остановки снимает сразу, не дожидаясь, пока до неё дойдёт очередь
+    std::weak_ptr<void> queued_task{};
+    bool (*cancel_queued)(void *task){nullptr};
+
+    // список обработчиков готовности; после публикации результата список закрывается меткой `closed()`
+    std::atomic<callback *> callbacks{nullptr};
+
+    std::optional<T> value{};
+    std::exception_ptr error{};
+
+    static callback *closed() { return reinterpret_cast<callback *>(std::uintptr_t(1)); }
+
+    void publish(std::uint32_t ready) {
+        if (state.exchange(ready, std::memory_order_acq_rel) & has_waiters) {
+            futex_wake_all(state);
+        }
+
+        callback *list = callbacks.exchange(closed(), std::memory_order_acq_rel);
+
+        // обработчики добавлялись в голову списка, вызываем их в порядке регистрации
+        callback *ordered = nullptr;
+        while (list) {
+            callback *next = list->next;
+            list->next = ordered;
+            ordered = list;
+            list = next;
+        }
+
+        while (ordered) {
+            std::unique_ptr<callback> current(ordered);
+            ordered = ordered->next;
+            current->invoke(*this);
+        }
+    }
+
+    // взводит признак ожидающих; `false`, если результат уже готов
+    bool announce_waiter(std::uint32_t &current) {
+        while (!(current & ready_mask)) {
+            if (current & has_waiters) {
+                return true;
+            }
+            if (state.compare_exchange_weak(current, current | has_waiters, std::memory_order_acquire)) {
+                current |= has_waiters;
+                return true;
+            }
+        }
+        return false;
+    }
+
+  public:
+    void add_reference() { references.fetch_add(1, std::memory_order_relaxed); }
+
+    void release() {
+        if ((references.fetch_sub(1, std::memory_order_acq_rel) & references_mask) == 1) {
+            delete this;
+        }
+    }
+
+    /**
+     * @brief Новая ссылка держателя результата (`Task<T>::Result`)
+     */
+    void add_holder() { references.fetch_add(holder + 1, std::memory_order_relaxed); }
+
+    /**
+     * @brief Новая ссылка держателя, если задачу ещё ждут: держатели есть и остановка не запрошена
+     * @return `false`, если запуск уже отменяется и присоединяться к нему нельзя
+     */
+    bool try_add_holder() {
+        std::uint64_t current = references.load(std::memory_order_relaxed);
+
+        do {
+            if ((current >> 32) == 0 || stop.stop_requested()) {
+                return false;
+            }
+        } while (!references.compare_exchange_weak(current, current + holder + 1, std::memory_order_relaxed));
+
+        return true;
+    }
+
+    /**
+     * @brief Отпускает ссылку держателя. Последний держатель запрашивает остановку задачи: результат больше никто не
+     * ждёт. Без конкуренции за счётчик - одна атомарная операция
+     */
+    void release_holder() {
+        std::uint64_t current = references.load(std::memory_order_relaxed);
+
+        while (true) {
+            if ((current >> 32) == 1) {
+                // свою ссылку последний держатель отпускает только после запроса остановки, иначе состояние может
+                // быть освобождено раньше
+                if (references.compare_exchange_weak(current, current - holder, std::memory_order_acq_rel,
+                                                     std::memory_order_relaxed)) {
+                    request_stop();
+                    release();
+                    return;
+                }
+            } else if (references.compare_exchange_weak(current, current - holder - 1, std::memory_order_acq_rel,
+                                                        std::memory_order_relaxed)) {
+                if ((current & references_mask) == 1) {
+                    delete this;
+                }
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief Запрошена ли остановка задачи: запуск уже отменяется
+     */
+    bool stop_requested() const { return stop.stop_requested(); }
+
+    /**
+     * @brief Число держателей результата, одна атомарная загрузка
+     */
+    std::uint32_t holders() const { return (std::uint32_t) (references.load(std::memory_order_acquire) >> 32); }
+
+    /**
+     * @brief Связывает результат с отменой задачи. Вызывается до появления держателей
+     */
+    void set_stop_source(stop_source source) { stop = std::move(source); }
+
+    /**
+     * @brief Связывает результат с задачей в очереди пула: `cancel(task)` отменяет её, если она ещё не взята
+     * потоком. Вызывается до постановки задачи в пул
+     */
+    void set_canceller(std::weak_ptr<void> task, bool (*cancel)(void *task)) {
+        queued_task = std::move(task);
+        cancel_queued = cancel;
+    }
+
+    /**
+     * @brief Запрашивает остановку задачи. Задача, которая ждёт в очереди, отменяется сразу в вызывающем потоке, а
+     * выполняющая шаг - потоком пула после шага
+     */
+    void request_stop() {
+        if (!stop.request_stop() || !cancel_queued) {
+            return;
+        }
+
+        // парный барьер - в `stepwise_function_wrapper::release`
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (auto task = queued_task.lock()) {
+            cancel_queued(task.get());
+        }
+    }
+
+    bool is_ready() const { return state.load(std::memory_order_acquire) & ready_mask; }
+
+    /**
+     * @brief Регистрирует обработчик `f(result_state &)`, который будет вызван в потоке, опубликовавшем результат.
+     * Если результат уже готов, `f` вызывается немедленно в вызывающем потоке
+     */
+    template <typename F> void on_ready(F &&f) {
+        auto node = std::make_unique<callback_impl<std::decay_t<F>>>(std::forward<F>(f));
+
+        callback *head = callbacks.load(std::memory_order_acquire);
+        do {
+            if (head == closed()) {
+                node->invoke(*this);
+                return;
+            }
+            node->next = head;
+        } while (!callbacks.compare_exchange_weak(head, node.get(), std::memory_order_release,
+                                                  std::memory_order_acquire));
+
+        node.release();
+    }
+
+    template <typename... Args> void set_value(Args &&...args) {
+        value.emplace(std::forward<Args>(args)...);
+        publish(has_value);
+    }
+
+    void set_exception(std::exception_ptr e) {
+        error = std::move(e);
+        publish(has_exception);
+    }
+
+    void set_cancelled() { publish(cancelled); }
+
+    /**
+     * @brief Чем завершилась задача: `completed`, `failed`, `cancelled` либо `running`, если результата ещё нет
+     */
+    task_status status() const {
+        std::uint32_t current = state.load(std::memory_order_acquire);
+        if (current & has_value) {
+            return task_status::completed;
+        }
+        if (current & has_exception) {
+            return task_status::failed;
+        }
+        return (current & cancelled) ? task_status::cancelled : task_status::running;
+    }
+
+    std::exception_ptr exception() const { return error; }
+
+    /**
+     * @brief Ждёт результат. В потоке пула выполняет шаги из его очереди, но не глубже
+     * `pool_options::max_help_depth` вложенных ожиданий: дальше поток ждёт, пока результат посчитают другие потоки
+     */
+    void wait() {
+        if (wait_helper *helper = wait_helper::current) {
+            // если очередь пуста, результат считают другие потоки: спим, но время от времени проверяем очередь,
+            // так как в неё могли попасть шаги, от которых зависит результат
+            while (!is_ready()) {
+                if (!helper->help()) {
+                    wait_for(std::chrono::microseconds(200));
+                }
+            }
+            return;
+        }
+
+        std::uint32_t current = state.load(std::memory_order_acquire);
+        while (announce_waiter(current)) {
+            futex_wait(state, current);
+            current = state.load(std::memory_order_acquire);
+        }
+    }
+
+    template <class Rep, class Period> std::future_status wait_for(const std::chrono::duration<Rep, Period> &timeout) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        std::uint32_t current = state.load(std::memory_order_acquire);
+
+        while (announce_waiter(current)) {
+            auto now = std::chrono::steady_clock::now();
+            auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now);
+            if (left.count() <= 0) {
+                return std::future_status::timeout;
+            }
+
+            futex_wait(state, current, &left);
+            current = state.load(std::memory_order_acquire);
+        }
+
+        return std::future_status::ready;
+    }
+
+    /**
+     * @brief Возвращает ссылку на значение либо выбрасывает сохранённое исключение, а для отменённой задачи -
+     * `bad_value`. Вызывать после `wait()`
+     */
+    T &get() {
+        std::uint32_t current = state.load(std::memory_order_acquire);
+        if (current & has_exception) {
+            std::rethrow_exception(error);
+        }
+        if (current & cancelled) {
+            throw bad_value{"stepwise: task was cancelled, value is incomplete"};
+        }
+        return *value;
+    }
+};
+
+/**
+ * @brief Итог задачи в духе `std::expected`: значение, отмена либо исключение. Отмена передаётся без исключения:
+ * ни при отмене задачи, ни при проверке итога исключение не создаётся и не выбрасывается
+ *
+ * - `outcome<const T &>` ссылается на значение в общем состоянии `shared_future` и действителен, пока оно живо
+ */
+template <typename T> class outcome {
+    using storage_type = std::conditional_t<std::is_reference_v<T>, std::remove_reference_t<T> *, std::optional<T>>;
+
+    task_status status_;
+    storage_type value_{};
+    std::exception_ptr error_{};
+
+    outcome(task_status status) : status_(status) {}
+
+  public:
+    static outcome completed(T value) {
+        outcome result(task_status::completed);
+        if constexpr (std::is_reference_v<T>) {
+            result.value_ = &value;
+        } else {
+            result.value_.emplace(std::move(value));
+        }
+        return result;
+    }
+
+    static outcome failed(std::exception_ptr error) {
+        outcome result(task_status::failed);
+        result.error_ = std::move(error);
+        return result;
+    }
+
+    static outcome cancelled() { return outcome(task_status::cancelled); }
+
+    /**
+     * @brief `completed`, `failed` либо `cancelled`
+     */
+    task_status status() const { return status_; }
+
+    bool has_value() const { return status_ == task_status::completed; }
+
+    bool is_cancelled() const { return status_ == task_status::cancelled; }
+
+    explicit operator bool() const { return has_value(); }
+
+    /**
+     * @brief Исключение задачи, `nullptr`, если задача не выбросила исключение
+     */
+    std::exception_ptr error() const { return error_; }
+
+    /**
+     * @brief Значение задачи
+     * @throw исключение задачи либо `bad_value`, если задача отменена
+     */
+    std::remove_reference_t<T> &value() {
+        if (status_ == task_status::failed) {
+            std::rethrow_exception(error_);
+        }
+        if (status_ == task_status::cancelled) {
+            throw bad_value{"stepwise: task was cancelled, value is incomplete"};
+        }
+        return *value_;
+    }
+
+    const std::remove_reference_t<T> &value() const { return const_cast<outcome *>(this)->value(); }
+
+    // без проверки, как у `std::expected`: вызывать, только если `has_value()`
+    std::remove_reference_t<T> &operator*() { return *value_; }
+    const std::remove_reference_t<T> &operator*() const { return *value_; }
+    std::remove_reference_t<T> *operator->() { return &*value_; }
+    const std::remove_reference_t<T> *operator->() const { return &*value_; }
+
+    template <typename U> std::remove_cv_t<std::remove_reference_t<T>> value_or(U &&fallback) const {
+        using value_type = std::remove_cv_t<std::remove_reference_t<T>>;
+        return has_value() ? value_type(*value_) : static_cast<value_type>(std::forward<U>(fallback));
+    }
+};
+
+template <typename T> class shared_future;
+template <typename T> class promise;
+
+namespace detail {
+struct result_access;
+}
+
+/**
+ * @brief Аналог `std::future` поверх `result_state`. Только перемещаемый, `get()` забирает значение
+ */
+template <typename T> class future {
+    template <typename> friend class promise;
+    friend class shared_future<T>;
+
+    result_state<T> *state{nullptr};
+
+    explicit future(result_state<T> *state) : state(state) {}
+
+    void check() const {
+        if (!state) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+    }
+
+  public:
+    future() = default;
+    future(const future &) = delete;
+    future(future &&other) noexcept : state(std::exchange(other.state, nullptr)) {}
+
+    ~future() {
+        if (state) {
+            state->release();
+        }
+    }
+
+    future &operator=(const future &) = delete;
+    future &operator=(future &&other) noexcept {
+        std::swap(state, other.state);
+        return *this;
+    }
+
+    bool valid() const { return state != nullptr; }
+
+    /**
+     * @brief Проверяет готовность результата одной атомарной загрузкой, без блокировок и системных вызовов
+     */
+    bool is_ready() const { return state && state->is_ready(); }
+
+    void wait() const {
+        check();
+        state->wait();
+    }
+
+    template <class Rep, class Period>
+    std::future_status wait_for(const std::chrono::duration<Rep, Period> &timeout_duration) const {
+        check();
+        return state->wait_for(timeout_duration);
+    }
+
+    template <class Clock, class Duration>
+    std::future_status wait_until(const std::chrono::time_point<Clock, Duration> &timeout_time) const {
+        return wait_for(timeout_time - Clock::now());
+    }
+
+    /**
+     * @brief Ожидает результат и забирает его. После вызова `valid() == false`
+     */
+    T get() {
+        check();
+        state->wait();
+
+        future released(std::move(*this));
+        return std::move(released.state->get());
+    }
+
+    /**
+     * @brief Ожидает результат и забирает его вместе со статусом, не выбрасывая исключений. После вызова
+     * `valid() == false`
+     */
+    outcome<T> get_outcome() {
+        check();
+        state->wait();
+
+        future released(std::move(*this));
+        return released.make_outcome();
+    }
+
+  private:
+    outcome<T> make_outcome() {
+        switch (state->status()) {
+        case task_status::completed:
+            return outcome<T>::completed(std::move(state->get()));
+        case task_status::failed:
+            return outcome<T>::failed(state->exception());
+        default:
+            return outcome<T>::cancelled();
+        }
+    }
+
+  public:
+
+    shared_future<T> share() { return shared_future<T>(std::move(*this)); }
+};
+
+/**
+ * @brief Аналог `std::shared_future` поверх `result_state`. Копирование - одна атомарная операция над счётчиком
+ * ссылок, дополнительного выделения памяти нет
+ */
+template <typename T> class shared_future {
+    friend struct detail::result_access;
+
+    result_state<T> *state{nullptr};
+
+    void check() const {
+        if (!state) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+    }
+
+    // новая ссылка на уже существующее состояние
+    explicit shared_future(result_state<T> &existing) : state(&existing) { state->add_reference(); }
+
+  public:
+    shared_future() = default;
+
+    shared_future(future<T> &&other) noexcept : state(std::exchange(other.state, nullptr)) {}
+
+    shared_future(const shared_future &other) noexcept : state(other.state) {
+        if (state) {
+            state->add_reference();
+        }
+    }
+
+    shared_future(shared_future &&other) noexcept : state(std::exchange(other.state, nullptr)) {}
+
+    ~shared_future() {
+        if (state) {
+            state->release();
+        }
+    }
+
+    shared_future &operator=(shared_future other) noexcept {
+        std::swap(state, other.state);
+        return *this;
+    }
+
+    bool valid() const { return state != nullptr; }
+
+    /**
+     * @brief Проверяет готовность результата одной атомарной загрузкой, без блокировок и системных вызовов
+     */
+    bool is_ready() const { return state && state->is_ready(); }
+
+    void wait() const {
+        check();
+        state->wait();
+    }
+
+    template <class Rep, class Period>
+    std::future_status wait_for(const std::chrono::duration<Rep, Period> &timeout_duration) const {
+        check();
+        return state->wait_for(timeout_duration);
+    }
+
+    template <class Clock, class Duration>
+    std::future_status wait_until(const std::chrono::time_point<Clock, Duration> &timeout_time) const {
+        return wait_for(timeout_time - Clock::now());
+    }
+
+    const T &get() const {
+        check();
+        state->wait();
+        return state->get();
+    }
+
+    /**
+     * @brief Ожидает результат и возвращает его вместе со статусом, не выбрасывая исключений. Значение не
+     * копируется: `outcome` ссылается на общее состояние
+     */
+    outcome<const T &> get_outcome() const {
+        check();
+        state->wait();
+
+        switch (state->status()) {
+        case task_status::completed:
+            return outcome<const T &>::completed(state->get());
+        case task_status::failed:
+            return outcome<const T &>::failed(state->exception());
+        default:
+            return outcome<const T &>::cancelled();
+        }
+    }
+
+    /**
+     * @brief Статус без ожидания: `running`, пока результата нет
+     */
+    task_status status() const { return state ? state->status() : task_status::running; }
+
+    /**
+     * @brief Регистрирует обработчик `f(const shared_future<T> &)`, который вызывается, как только результат готов
+     *
+     * - Обработчик выполняется в потоке, установившем результат (обычно поток пула), поэтому должен быть коротким
+     *
+     * - Если результат уже готов, `f` вызывается немедленно в вызывающем потоке
+     *
+     * - Регистрация не блокирует и не требует отдельного ожидающего потока
+     */
+    template <typename F> void on_ready(F &&f) const {
+        check();
+        state->on_ready([f = std::forward<F>(f)](result_state<T> &ready) mutable { f(shared_future<T>(ready)); });
+    }
+
+    /**
+     * @brief Продолжение: когда результат будет готов, в пул `pool` ставится задача `f(get())`
+     *
+     * - Если результат содержит исключение, `f` не вызывается, исключение передаётся в результат продолжения. Так же
+     * передаётся и отмена
+     *
+     * - Если к моменту готовности пул уже разрушен, результат продолжения получит `std::future_error(broken_promise)`
+     * @param pool Пул потоков, в котором выполнится `f`
+     * @param f Вызываемый объект, принимающий `const T &` и возвращающий не `void`
+     * @return `shared_future` результата `f`, у которого тоже есть `then`, что позволяет строить цепочки
+     */
+    template <typename Pool, typename F> auto then(const std::shared_ptr<Pool> &pool, F &&f) const {
+        typedef std::invoke_result_t<std::decay_t<F> &, const T &> result_type;
+
+        promise<result_type> p;
+        shared_future<result_type> result = p.get_future().share();
+
+        on_ready([weak_pool = std::weak_ptr<Pool>(pool), p = std::move(p),
+                  f = std::forward<F>(f)](const shared_future<T> &source) mutable {
+            // отмена передаётся продолжению без исключения и без задачи в пуле
+            if (source.status() == task_status::cancelled) {
+                p.set_cancelled();
+                return;
+            }
+
+            if (auto pool = weak_pool.lock()) {
+                auto continuation = [source, f = std::move(f)]() mutable -> result_type { return f(source.get()); };
+                pool->submit_with_promise(std::move(p), std::move(continuation));
+            }
+        });
+
+        return result;
+    }
+};
+
+namespace detail {
+
+/**
+ * @brief Доступ держателей результата (`Task<T>::Result`) к общему состоянию `shared_future`
+ */
+struct result_access {
+    template <typename T> static result_state<T> *state(const shared_future<T> &future) { return future.state; }
+
+    // новая ссылка на состояние в виде `shared_future`
+    template <typename T> static shared_future<T> share(result_state<T> &state) { return shared_future<T>(state); }
+};
+
+} // namespace detail
+
+/**
+ * @brief Аналог `std::promise` поверх `result_state`. Если результат так и не был установлен, при разрушении
+ * в состояние записывается `std::future_error(broken_promise)`
+ */
+template <typename T> class promise {
+    result_state<T> *state{new result_state<T>()};
+    bool future_retrieved{false};
+    bool satisfied{false};
+
+    void satisfy() {
+        if (!state) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        if (satisfied) {
+            throw std::future_error(std::future_errc::promise_already_satisfied);
+        }
+        satisfied = true;
+    }
+
+  public:
+    promise() = default;
+    promise(const promise &) = delete;
+    promise(promise &&other) noexcept
+        : state(std::exchange(other.state, nullptr)), future_retrieved(other.future_retrieved),
+          satisfied(other.satisfied) {}
+
+    ~promise() {
+        if (state) {
+            if (!satisfied) {
+                state->set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+            }
+            state->release();
+        }
+    }
+
+    promise &operator=(const promise &) = delete;
+    promise &operator=(promise &&other) noexcept {
+        promise tmp(std::move(other));
+        std::swap(state, tmp.state);
+        std::swap(future_retrieved, tmp.future_retrieved);
+        std::swap(satisfied, tmp.satisfied);
+        return *this;
+    }
+
+    future<T> get_future() {
+        if (!state) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        if (future_retrieved) {
+            throw std::future_error(std::future_errc::future_already_retrieved);
+        }
+
+        future_retrieved = true;
+        state->add_reference();
+        return future<T>(state);
+    }
+
+    void set_value(const T &value) {
+        satisfy();
+        state->set_value(value);
+    }
+
+    void set_value(T &&value) {
+        satisfy();
+        state->set_value(std::move(value));
+    }
+
+    void set_exception(std::exception_ptr e) {
+        satisfy();
+        state->set_exception(std::move(e));
+    }
+
+    /**
+     * @brief Завершает результат отменой: `get()` выбросит `bad_value`, а `get_outcome()` вернёт `cancelled` без
+     * исключения. Само исключение не создаётся, пока его не запросят
+     */
+    void set_cancelled() {
+        satisfy();
+        state->set_cancelled();
+    }
+};
+
+/**
+ * @brief Результат `when_any`: номер первого готового результата и его значение
+ */
+template <typename T> struct when_any_result {
+    std::size_t index;
+    T value;
+};
+
+/**
+ * @brief Объединяет результаты: возвращённый `shared_future` готов, когда готовы все `futures`
+ *
+ * - Ожидающий поток не нужен: готовность отслеживается обработчиками `on_ready` и атомарным счётчиком
+ *
+ * - Если хотя бы один результат содержит исключение или отменён, итоговый результат содержит исключение либо отмену
+ * первого по порядку такого результата
+ * @return значения в порядке `futures`
+ */
+template <typename T> shared_future<std::vector<T>> when_all(const std::vector<shared_future<T>> &futures) {
+    struct context {
+        promise<std::vector<T>> all;
+        std::vector<shared_future<T>> inputs;
+        std::atomic<std::size_t> left;
+    };
+
+    auto ctx = std::make_shared<context>();
+    ctx->inputs = futures;
+    ctx->left.store(futures.size());
+
+    shared_future<std::vector<T>> result = ctx->all.get_future().share();
+
+    if (futures.empty()) {
+        ctx->all.set_value(std::vector<T>{});
+        return result;
+    }
+
+    for (auto &input : futures) {
+        input.on_ready([ctx](const shared_future<T> &) {
+            if (ctx->left.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                return;
+            }
+
+            for (auto &ready : ctx->inputs) {
+                if (ready.status() == task_status::cancelled) {
+                    ctx->all.set_cancelled();
+                    return;
+                }
+                if (ready.status() == task_status::failed) {
+                    break;
+                }
+            }
+
+            try {
+                std::vector<T> values;
+                values.reserve(ctx->inputs.size());
+                for (auto &ready : ctx->inputs) {
+                    values.push_back(ready.get());
+                }
+                ctx->all.set_value(std::move(values));
+            } catch (...) {
+                ctx->all.set_exception(std::current_exception());
+            }
+        });
+    }
+
+    return result;
+}
+
+/**
+ * @brief Возвращённый `shared_future` готов, как только готов любой из `futures`
+ *
+ * - Ожидающий поток не нужен: побеждает обработчик `on_ready`, первым взведший атомарный флаг
+ *
+ * - Если первый готовый результат содержит исключение или отменён, итоговый результат содержит это исключение либо
+ * отмену
+ *
+ * - Для пустого `futures` результат содержит `std::invalid_argument`
+ */
+template <typename T> shared_future<when_any_result<T>> when_any(const std::vector<shared_future<T>> &futures) {
+    struct context {
+        promise<when_any_result<T>> any;
+        std::atomic_bool decided{false};
+    };
+
+    auto ctx = std::make_shared<context>();
+    shared_future<when_any_result<T>> result = ctx->any.get_future().share();
+
+    if (futures.empty()) {
+        ctx->any.set_exception(std::make_exception_ptr(std::invalid_argument("when_any: no results to wait for")));
+        return result;
+    }
+
+    for (std::size_t i = 0; i < futures.size(); ++i) {
+        futures[i].on_ready([ctx, i](const shared_future<T> &ready) {
+            if (ctx->decided.exchange(true, std::memory_order_acq_rel)) {
+                return;
+            }
+
+            if (ready.status() == task_status::cancelled) {
+                ctx->any.set_cancelled();
+                return;
+            }
+
+            try {
+                ctx->any.set_value(when_any_result<T>{i, ready.get()});
+            } catch (...) {
+                ctx->any.set_exception(std::current_exception());
+            }
+        });
+    }
+
+    return result;
+}
+
+} // namespace stepwise
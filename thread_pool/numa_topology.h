@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace stepwise {
+
+/**
+ * @brief Описание одного NUMA-узла: его номер и список логических процессоров
+ */
+struct numa_node {
+    int id;
+    std::vector<int> cpus;
+};
+
+/**
+ * @brief Разбирает список процессоров в формате ядра Linux, например `0-3,8,10-11`
+ */
+inline std::vector<int> parse_cpu_list(const std::string &list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+
+        auto dash = range.find('-');
+        try {
+            int first = std::stoi(range.substr(0, dash));
+            int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        } catch (...) {
+            return {};
+        }
+    }
+
+    return cpus;
+}
+
+/**
+ * @brief Определяет NUMA-топологию машины
+ * @return
+ * - Список узлов с процессорами, прочитанный из `/sys/devices/system/node`
+ *
+ * - Если топологию определить не удалось, один узел со всеми процессорами
+ */
+inline std::vector<numa_node> numa_topology() {
+    std::vector<numa_node> nodes;
+
+#ifdef __linux__
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string online_list;
+
+    if (online && std::getline(online, online_list)) {
+        for (int id : parse_cpu_list(online_list)) {
+            std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+            std::string list;
+
+            if (cpulist && std::getline(cpulist, list)) {
+                auto cpus = parse_cpu_list(list);
+                if (!cpus.empty()) { // узлы без процессоров (только память) потоков не получают
+                    nodes.push_back({id, std::move(cpus)});
+                }
+            }
+        }
+    }
+#endif
+
+    if (nodes.empty()) {
+        unsigned hw = std::thread::hardware_concurrency();
+        numa_node all{0, {}};
+        for (unsigned cpu = 0; cpu < (hw ? hw : 1); ++cpu) {
+            all.cpus.push_back(cpu);
+        }
+        nodes.push_back(std::move(all));
+    }
+
+    return nodes;
+}
+
+/**
+ * @brief Закрепляет поток за набором логических процессоров
+ * @return код ошибки `pthread_setaffinity_np`; `0` - успех. На платформах без поддержки всегда `0`, закрепление
+ * не выполняется
+ */
+inline int pin_thread(std::thread &thread, const std::vector<int> &cpus) {
+#ifdef __linux__
+    if (cpus.empty()) {
+        return 0;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < 0 || cpu >= CPU_SETSIZE) {
+            return EINVAL;
+        }
+        CPU_SET(cpu, &set);
+    }
+
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+    (void) thread;
+    (void) cpus;
+    return 0;
+#endif
+}
+
+} // namespace stepwise
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <vector>
+
+#include "fine_grained_thread_pool.h"
+#include "future.h"
+
+namespace stepwise {
+
+namespace detail {
+
+/**
+ * @brief Общее состояние параллельного цикла по `[0, size)`
+ *
+ * - Участники (вызывающий поток и задачи-помощники в пуле) забирают куски диапазона атомарным курсором. Размер куска
+ * убывает вместе с остатком (`остаток / (2 * участники)`, но не меньше `grain`): сначала крупные куски без лишней
+ * синхронизации, в конце мелкие, чтобы участники заканчивали одновременно
+ *
+ * - Живёт в `std::shared_ptr`: помощник, до которого очередь дошла после окончания цикла, не найдёт работы и сразу
+ * завершится, не трогая `body`
+ */
+template <typename Body> struct parallel_loop {
+    Body body; // body(begin, end)
+    std::size_t size;
+    std::size_t grain;
+    std::size_t participants;
+
+    std::atomic<std::size_t> next{0};
+    std::atomic<std::size_t> finished{0};
+    std::atomic<std::uint32_t> done{0};
+
+    std::atomic_bool failed{false};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    parallel_loop(Body body, std::size_t size, std::size_t grain, std::size_t participants)
+        : body(std::move(body)), size(size), grain(grain), participants(participants) {}
+
+    bool grab(std::size_t &begin, std::size_t &end) {
+        std::size_t current = next.load(std::memory_order_relaxed);
+
+        while (current < size) {
+            std::size_t chunk = std::max(grain, (size - current) / (2 * participants));
+            std::size_t stop = std::min(size, current + chunk);
+
+            if (next.compare_exchange_weak(current, stop, std::memory_order_relaxed)) {
+                begin = current;
+                end = stop;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void run() {
+        std::size_t begin, end;
+
+        while (grab(begin, end)) {
+            // после ошибки оставшиеся куски только отмечаются выполненными
+            if (!failed.load(std::memory_order_relaxed)) {
+                try {
+                    body(begin, end);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lg{error_mutex};
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                    failed.store(true, std::memory_order_relaxed);
+                }
+            }
+
+            if (finished.fetch_add(end - begin, std::memory_order_acq_rel) + (end - begin) == size) {
+                done.store(1, std::memory_order_release);
+                futex_wake_all(done);
+            }
+        }
+    }
+};
+
+/**
+ * @brief Выполняет `body(begin, end)` для кусков `[0, size)` в пуле. Вызывающий поток участвует в работе и
+ * возвращается, когда обработан весь диапазон
+ * @throw первое исключение, выброшенное `body`
+ */
+template <typename Body>
+void run_parallel(fine_grained_thread_pool &pool, std::size_t size, std::size_t grain, Body &&body) {
+    if (size == 0) {
+        return;
+    }
+
+    grain = std::max<std::size_t>(grain, 1);
+    std::size_t helpers = std::min<std::size_t>(pool.threads_count(), (size + grain - 1) / grain - 1);
+
+    auto loop = std::make_shared<parallel_loop<std::decay_t<Body>>>(std::forward<Body>(body), size, grain,
+                                                                    helpers + 1);
+
+    auto helper = [loop]() {
+        loop->run();
+        return true;
+    };
+    pool.submit_bulk(std::vector<decltype(helper)>(helpers, helper));
+
+    loop->run();
+
+    // остались только куски, которые уже выполняют помощники
+    while (loop->done.load(std::memory_order_acquire) == 0) {
+        futex_wait(loop->done, 0);
+    }
+
+    if (loop->error) {
+        std::rethrow_exception(loop->error);
+    }
+}
+
+/**
+ * @brief Число блоков для алгоритмов, которые делят диапазон на равные части: по два на участника, но не мельче
+ * `min_block` элементов
+ */
+inline std::size_t blocks_for(fine_grained_thread_pool &pool, std::size_t size, std::size_t min_block) {
+    std::size_t blocks = 2 * ((std::size_t) pool.threads_count() + 1);
+    return std::max<std::size_t>(1, std::min(blocks, size / min_block));
+}
+
+} // namespace detail
+
+/**
+ * @brief Вызывает `f(i)` для каждого `i` из `[first, last)` на потоках пула `pool`
+ *
+ * - Вызывающий поток не блокируется в ожидании, а выполняет часть итераций сам, поэтому функцию можно вызывать и из
+ * задачи пула
+ *
+ * - `first`/`last` - целые числа либо итераторы произвольного доступа
+ * @param grain Минимальное число итераций в одном куске
+ * @throw первое исключение, выброшенное `f`. Итерации, не начатые к этому моменту, не выполняются
+ */
+template <typename Index, typename F>
+void parallel_for(fine_grained_thread_pool &pool, Index first, Index last, F &&f, std::size_t grain = 1) {
+    using difference_type = decltype(last - first);
+
+    detail::run_parallel(pool, (std::size_t) (last - first), grain, [first, &f](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            f(first + (difference_type) i);
+        }
+    });
+}
+
+/**
+ * @brief Параллельный аналог `std::transform_reduce`: `reduce(init, transform(*it)...)` для `[first, last)`
+ *
+ * - Порядок объединения не определён, поэтому `reduce` должна быть ассоциативной и коммутативной
+ * @param grain Минимальное число элементов в одном куске
+ */
+template <typename Iterator, typename T, typename Reduce, typename Transform>
+T parallel_transform_reduce(fine_grained_thread_pool &pool, Iterator first, Iterator last, T init, Reduce reduce,
+                            Transform transform, std::size_t grain = 1) {
+    std::mutex total_mutex;
+    T total = std::move(init);
+
+    detail::run_parallel(pool, (std::size_t) std::distance(first, last), grain,
+                         [&](std::size_t begin, std::size_t end) {
+                             auto it = first + begin;
+                             T partial = transform(*it);
+                             for (++it; it != first + end; ++it) {
+                                 partial = reduce(std::move(partial), transform(*it));
+                             }
+
+                             std::lock_guard<std::mutex> lg{total_mutex};
+                             total = reduce(std::move(total), std::move(partial));
+                         });
+
+    return total;
+}
+
+/**
+ * @brief Параллельная сортировка `[first, last)`: блоки сортируются `std::sort` на потоках пула, затем попарно
+ * сливаются, пары одного уровня - тоже параллельно. Сортировка неустойчивая
+ */
+template <typename Iterator, typename Compare = std::less<>>
+void parallel_sort(fine_grained_thread_pool &pool, Iterator first, Iterator last, Compare comp = Compare{}) {
+    std::size_t size = (std::size_t) std::distance(first, last);
+    std::size_t blocks = detail::blocks_for(pool, size, 2048);
+
+    if (blocks == 1) {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    auto bound = [&](std::size_t block) { return first + (std::ptrdiff_t) (size * block / blocks); };
+
+    detail::run_parallel(pool, blocks, 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t block = begin; block < end; ++block) {
+            std::sort(bound(block), bound(block + 1), comp);
+        }
+    });
+
+    for (std::size_t width = 1; width < blocks; width *= 2) {
+        std::size_t pairs = (blocks + 2 * width - 1) / (2 * width);
+
+        detail::run_parallel(pool, pairs, 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t pair = begin; pair < end; ++pair) {
+                std::size_t left = pair * 2 * width;
+                std::size_t middle = std::min(left + width, blocks);
+                std::size_t right = std::min(left + 2 * width, blocks);
+
+                if (middle < right) {
+                    std::inplace_merge(bound(left), bound(middle), bound(right), comp);
+                }
+            }
+        });
+    }
+}
+
+/**
+ * @brief Параллельный аналог `std::inclusive_scan`: в `d_first` записываются префиксные `op`-суммы `[first, last)`
+ *
+ * - Три прохода: суммы блоков (параллельно), сдвиги блоков (последовательно, по числу блоков), префиксные суммы
+ * внутри блоков (параллельно). `op` должна быть ассоциативной. Допускается `d_first == first`
+ * @return итератор за последним записанным элементом
+ */
+template <typename InputIterator, typename OutputIterator, typename BinaryOp = std::plus<>>
+OutputIterator parallel_scan(fine_grained_thread_pool &pool, InputIterator first, InputIterator last,
+                             OutputIterator d_first, BinaryOp op = BinaryOp{}) {
+    using value_type = typename std::iterator_traits<InputIterator>::value_type;
+
+    std::size_t size = (std::size_t) std::distance(first, last);
+    std::size_t blocks = detail::blocks_for(pool, size, 1024);
+
+    if (blocks == 1) {
+        return std::inclusive_scan(first, last, d_first, op);
+    }
+
+    auto bound = [&](std::size_t block) { return (std::ptrdiff_t) (size * block / blocks); };
+
+    std::vector<std::optional<value_type>> carry(blocks);
+
+    detail::run_parallel(pool, blocks - 1, 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t block = begin; block < end; ++block) {
+            carry[block + 1] = std::accumulate(first + bound(block) + 1, first + bound(block + 1),
+                                               value_type(first[bound(block)]), op);
+        }
+    });
+
+    for (std::size_t block = 2; block < blocks; ++block) {
+        // сдвиг предыдущего блока ещё нужен третьему проходу, перемещать можно только сумму текущего
+        carry[block] = op(*carry[block - 1], std::move(*carry[block]));
+    }
+
+    detail::run_parallel(pool, blocks, 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t block = begin; block < end; ++block) {
+            if (carry[block]) {
+                std::inclusive_scan(first + bound(block), first + bound(block + 1), d_first + bound(block), op,
+                                    *carry[block]);
+            } else {
+                std::inclusive_scan(first + bound(block), first + bound(block + 1), d_first + bound(block), op);
+            }
+        }
+    });
+
+    return d_first + (std::ptrdiff_t) size;
+}
+
+} // namespace stepwise
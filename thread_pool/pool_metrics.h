@@ -0,0 +1,343 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "task_status.h"
+
+// Сбор метрик пула потоков. Определите `STEPWISE_POOL_METRICS 0` до подключения заголовков, чтобы полностью убрать
+// счётчики из пула и обёрток задач
+#ifndef STEPWISE_POOL_METRICS
+#define STEPWISE_POOL_METRICS 1
+#endif
+
+namespace stepwise {
+
+using metrics_clock = std::chrono::steady_clock;
+
+/**
+ * @brief Снимок гистограммы. Корзина `i` содержит количество значений из диапазона `[2^(i-1), 2^i)`, корзина `0` -
+ * количество нулевых значений
+ */
+struct histogram_snapshot {
+    static constexpr std::size_t buckets_count = 64;
+
+    std::array<std::uint64_t, buckets_count> buckets{};
+    std::uint64_t count = 0;
+
+    /**
+     * @brief Верхняя граница корзины, в которую попадает перцентиль `p` (от `0` до `1`)
+     */
+    std::uint64_t percentile(double p) const {
+        if (count == 0) {
+            return 0;
+        }
+
+        std::uint64_t rank = (std::uint64_t) (p * (double) count);
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < buckets_count; ++i) {
+            seen += buckets[i];
+            if (seen > rank || seen == count) {
+                return (i == 0) ? 0 : ((std::uint64_t) 1 << i) - 1;
+            }
+        }
+
+        return UINT64_MAX;
+    }
+
+    histogram_snapshot &operator+=(const histogram_snapshot &other) {
+        for (std::size_t i = 0; i < buckets_count; ++i) {
+            buckets[i] += other.buckets[i];
+        }
+        count += other.count;
+        return *this;
+    }
+};
+
+/**
+ * @brief Метрики одного потока пула
+ */
+struct worker_metrics_snapshot {
+    unsigned index = 0;
+    unsigned node = 0;
+
+    std::uint64_t steps = 0;
+    std::uint64_t tasks_completed = 0;  // задача вернула значение
+    std::uint64_t tasks_failed = 0;     // задача выбросила исключение
+    std::uint64_t tasks_cancelled = 0;  // задача завершена досрочно по `cond()`
+    std::uint64_t deadlines_missed = 0; // задача завершилась позже `submit_options::deadline`
+
+    std::chrono::nanoseconds busy{0};
+    std::chrono::nanoseconds idle{0};
+
+    /**
+     * @brief Доля времени, которую поток выполнял шаги задач
+     */
+    double utilization() const {
+        auto total = busy + idle;
+        return total.count() ? (double) busy.count() / (double) total.count() : 0.0;
+    }
+};
+
+/**
+ * @brief Потребление одной группы задач (`submit_options::group`)
+ */
+struct group_metrics_snapshot {
+    unsigned group = 0;
+    unsigned weight = 1;
+
+    std::uint64_t steps = 0;
+    std::chrono::nanoseconds busy{0}; // суммарное время шагов задач группы
+};
+
+/**
+ * @brief Снимок метрик `fine_grained_thread_pool`, собранный по запросу из счётчиков потоков
+ */
+struct pool_metrics_snapshot {
+    std::vector<worker_metrics_snapshot> workers;
+
+    // текущая длина очереди каждого подпула
+    std::vector<std::size_t> queue_depth;
+
+    // потребление групп задач. Заполняется, только если при создании пула заданы `pool_options::group_weights`
+    std::vector<group_metrics_snapshot> groups;
+
+    std::uint64_t tasks_submitted = 0;
+
+    // время от постановки задачи в пул до начала первого шага, нс
+    histogram_snapshot wait_before_first_step;
+    // длительность одного шага, нс
+    histogram_snapshot step_duration;
+    // количество шагов до завершения задачи
+    histogram_snapshot steps_per_task;
+
+    std::uint64_t steps() const {
+        std::uint64_t sum = 0;
+        for (auto &worker : workers) {
+            sum += worker.steps;
+        }
+        return sum;
+    }
+
+    std::uint64_t tasks_completed() const {
+        std::uint64_t sum = 0;
+        for (auto &worker : workers) {
+            sum += worker.tasks_completed;
+        }
+        return sum;
+    }
+
+    std::uint64_t tasks_failed() const {
+        std::uint64_t sum = 0;
+        for (auto &worker : workers) {
+            sum += worker.tasks_failed;
+        }
+        return sum;
+    }
+
+    std::uint64_t tasks_cancelled() const {
+        std::uint64_t sum = 0;
+        for (auto &worker : workers) {
+            sum += worker.tasks_cancelled;
+        }
+        return sum;
+    }
+
+    std::uint64_t deadlines_missed() const {
+        std::uint64_t sum = 0;
+        for (auto &worker : workers) {
+            sum += worker.deadlines_missed;
+        }
+        return sum;
+    }
+
+    /**
+     * @brief Доля времени шагов, которую получила группа `group`, среди всех групп
+     */
+    double group_share(unsigned group) const {
+        std::chrono::nanoseconds total{0};
+        for (auto &g : groups) {
+            total += g.busy;
+        }
+        return (group < groups.size() && total.count()) ? (double) groups[group].busy.count() / (double) total.count()
+                                                         : 0.0;
+    }
+};
+
+/**
+ * @brief Сведения о задаче, которые нужны для метрик: время постановки и число выполненных шагов
+ */
+struct task_metrics {
+#if STEPWISE_POOL_METRICS
+    metrics_clock::time_point submitted{};
+    std::uint64_t steps = 0;
+
+    void on_submit() { submitted = metrics_clock::now(); }
+#else
+    void on_submit() {}
+#endif
+};
+
+/**
+ * @brief Учёт времени шагов одной группы задач. Пишут все потоки пула, поэтому счётчики - атомарные
+ * read-modify-write. Не зависит от `STEPWISE_POOL_METRICS`: по этому учёту работает `scheduling::fair_share`
+ */
+class alignas(64) group_account {
+    unsigned index;
+    unsigned weight;
+
+    std::atomic<std::uint64_t> steps{0};
+    std::atomic<std::uint64_t> busy_ns{0};
+
+  public:
+    group_account(unsigned index, unsigned weight) : index(index), weight(weight ? weight : 1) {}
+
+    void record_step(std::chrono::nanoseconds duration) {
+        steps.fetch_add(1, std::memory_order_relaxed);
+        busy_ns.fetch_add(duration.count() > 0 ? (std::uint64_t) duration.count() : 0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Время шагов группы, делённое на её вес
+     */
+    double virtual_time() const { return (double) busy_ns.load(std::memory_order_relaxed) / weight; }
+
+    void add_to(pool_metrics_snapshot &snapshot) const {
+        group_metrics_snapshot group;
+        group.group = index;
+        group.weight = weight;
+        group.steps = steps.load(std::memory_order_relaxed);
+        group.busy = std::chrono::nanoseconds(busy_ns.load(std::memory_order_relaxed));
+        snapshot.groups.push_back(group);
+    }
+};
+
+#if STEPWISE_POOL_METRICS
+
+/**
+ * @brief Счётчики одного потока пула. Пишет в них только владеющий поток, поэтому вместо атомарных
+ * read-modify-write операций используются пары relaxed load/store; читать снимок можно из любого потока
+ */
+class alignas(64) worker_metrics {
+    class histogram {
+        std::array<std::atomic<std::uint64_t>, histogram_snapshot::buckets_count> buckets{};
+
+      public:
+        void record(std::uint64_t value) {
+            std::size_t bucket = 0;
+            while (value) {
+                ++bucket;
+                value >>= 1;
+            }
+
+            auto &counter = buckets[bucket < histogram_snapshot::buckets_count ? bucket : buckets.size() - 1];
+            counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        void add_to(histogram_snapshot &snapshot) const {
+            for (std::size_t i = 0; i < buckets.size(); ++i) {
+                auto n = buckets[i].load(std::memory_order_relaxed);
+                snapshot.buckets[i] += n;
+                snapshot.count += n;
+            }
+        }
+    };
+
+    static void increment(std::atomic<std::uint64_t> &counter, std::uint64_t value = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    unsigned index;
+    unsigned node;
+
+    std::atomic<std::uint64_t> steps{0};
+    std::atomic<std::uint64_t> completed{0};
+    std::atomic<std::uint64_t> failed{0};
+    std::atomic<std::uint64_t> cancelled{0};
+    std::atomic<std::uint64_t> missed{0};
+    std::atomic<std::uint64_t> busy_ns{0};
+    std::atomic<std::uint64_t> idle_ns{0};
+
+    histogram wait_before_first_step;
+    histogram step_duration;
+    histogram steps_per_task;
+
+  public:
+    worker_metrics(unsigned index, unsigned node) : index(index), node(node) {}
+
+    metrics_clock::time_point now() const { return metrics_clock::now(); }
+
+    void record_idle(metrics_clock::time_point from, metrics_clock::time_point to) {
+        increment(idle_ns, (std::uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+    }
+
+    /**
+     * @param nested Время шагов других задач, выполненных этим потоком внутри шага, пока он ждал результат. Они
+     * учитываются сами и из длительности шага вычитаются
+     */
+    void record_step(task_metrics &task, metrics_clock::time_point begin, metrics_clock::time_point end,
+                     std::chrono::nanoseconds nested) {
+        auto own = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin) - nested;
+        auto duration = own.count() > 0 ? (std::uint64_t) own.count() : 0;
+
+        if (task.steps++ == 0) {
+            auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(begin - task.submitted).count();
+            wait_before_first_step.record(wait > 0 ? (std::uint64_t) wait : 0);
+        }
+
+        increment(steps);
+        increment(busy_ns, duration);
+        step_duration.record(duration);
+    }
+
+    void record_finish(const task_metrics &task, task_status status) {
+        increment(status == task_status::completed ? completed
+                                                   : (status == task_status::failed ? failed : cancelled));
+        steps_per_task.record(task.steps);
+    }
+
+    void record_deadline(metrics_clock::time_point deadline, metrics_clock::time_point finished) {
+        if (finished > deadline) {
+            increment(missed);
+        }
+    }
+
+    void add_to(pool_metrics_snapshot &snapshot) const {
+        worker_metrics_snapshot worker;
+        worker.index = index;
+        worker.node = node;
+        worker.steps = steps.load(std::memory_order_relaxed);
+        worker.tasks_completed = completed.load(std::memory_order_relaxed);
+        worker.tasks_failed = failed.load(std::memory_order_relaxed);
+        worker.tasks_cancelled = cancelled.load(std::memory_order_relaxed);
+        worker.deadlines_missed = missed.load(std::memory_order_relaxed);
+        worker.busy = std::chrono::nanoseconds(busy_ns.load(std::memory_order_relaxed));
+        worker.idle = std::chrono::nanoseconds(idle_ns.load(std::memory_order_relaxed));
+        snapshot.workers.push_back(worker);
+
+        wait_before_first_step.add_to(snapshot.wait_before_first_step);
+        step_duration.add_to(snapshot.step_duration);
+        steps_per_task.add_to(snapshot.steps_per_task);
+    }
+};
+
+#else
+
+class worker_metrics {
+  public:
+    worker_metrics(unsigned, unsigned) {}
+
+    metrics_clock::time_point now() const { return {}; }
+    void record_idle(metrics_clock::time_point, metrics_clock::time_point) {}
+    void record_step(task_metrics &, metrics_clock::time_point, metrics_clock::time_point, std::chrono::nanoseconds) {}
+    void record_finish(const task_metrics &, task_status) {}
+    void record_deadline(metrics_clock::time_point, metrics_clock::time_point) {}
+    void add_to(pool_metrics_snapshot &) const {}
+};
+
+#endif
+
+} // namespace stepwise
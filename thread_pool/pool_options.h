@@ -0,0 +1,141 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include "stop_token.h"
+
+namespace stepwise {
+
+/**
+ * @brief Порядок, в котором потоки пула берут шаги задач из очереди
+ */
+enum class scheduling {
+    // по кругу: задача, не завершённая за шаг, встаёт в конец очереди
+    fifo,
+    // первым выполняется шаг задачи с самым ранним сроком (`submit_options::deadline`), задачи с равными сроками - по
+    // кругу. Задачи без срока выполняются, только когда в очереди нет задач со сроком
+    earliest_deadline,
+    // у каждой группы задач (`submit_options::group`) своя очередь, первым выполняется шаг группы, потратившей
+    // меньше всего времени шагов с учётом веса (`pool_options::group_weights`). Внутри группы - по кругу
+    fair_share,
+};
+
+/**
+ * @brief Привязка шагов пошаговой задачи к потоку пула. Шаги, выполненные одним потоком, застают состояние задачи в
+ * его кэше
+ */
+enum class affinity {
+    // шаг выполняет любой поток подпула
+    none,
+    // следующий шаг выполняет поток, выполнивший предыдущий, но простаивающий поток того же подпула может забрать
+    // задачу себе
+    soft,
+    // все шаги выполняет один поток, выбранный по ключу (`submit_options::affinity_key`). Задачи с одинаковым ключом
+    // выполняются одним потоком
+    hard,
+};
+
+/**
+ * @brief Параметры создания `fine_grained_thread_pool`
+ */
+struct pool_options {
+    // Количество потоков. `0` - по одному потоку на каждый доступный процессор
+    unsigned number_of_threads = 0;
+
+    // Наборы процессоров для закрепления потоков: i-й поток закрепляется за `cpu_sets[i % cpu_sets.size()]`.
+    // Пустой вектор - потоки не закрепляются. В режиме `numa_aware` не используется
+    std::vector<std::vector<int>> cpu_sets{};
+
+    // Создать по подпулу на каждый NUMA-узел: у каждого узла своя очередь задач, а его потоки закреплены за
+    // процессорами узла
+    bool numa_aware = false;
+
+    // Порядок выполнения шагов задач
+    scheduling order = scheduling::fifo;
+
+    // Веса групп задач (арендаторов): `group_weights[i]` - вес группы `i`. В режиме `scheduling::fair_share` группы
+    // получают время потоков пропорционально весам. Если вектор не пуст, время шагов каждой группы учитывается в
+    // метриках пула в любом режиме. Пустой вектор - одна группа без учёта
+    std::vector<unsigned> group_weights{};
+
+    // Сколько шагов поток может выполнить вложенно, пока ждёт результат (`wait()`/`get()` в задаче пула). Шаги,
+    // выполненные в ожидании, лежат на стеке ждущего шага. Глубже поток просто ждёт, поэтому цепочка ожиданий
+    // длиннее `max_help_depth` требует свободного потока: в пуле из одного потока она не завершится
+    unsigned max_help_depth = 16;
+};
+
+/**
+ * @brief Параметры постановки задачи в `fine_grained_thread_pool`. Передаются последним аргументом `submit`
+ */
+struct submit_options {
+    // NUMA-узел (индекс подпула), в очередь которого попадёт задача. `-1` - узел вызывающего потока, если он из
+    // пула, иначе узлы перебираются по кругу
+    int node = -1;
+
+    // Имя задачи в трассе (`stepwise::tracer`). Строка должна жить до записи трассы, для имён, собранных во время
+    // выполнения, используйте `tracer::intern`
+    const char *name = nullptr;
+
+    // Токен отмены: после запроса остановки задача завершается досрочно, не дожидаясь `cond()`, а очередной шаг уже
+    // не выполняется
+    stop_token stop{};
+
+    // Срок, к которому задача должна завершиться. Задает порядок шагов в режиме `scheduling::earliest_deadline`, а
+    // задачи, завершившиеся позже срока, учитываются в метриках пула в любом режиме. По умолчанию срока нет
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+
+    // Группа задачи (арендатор), индекс в `pool_options::group_weights`. Берётся по модулю числа групп
+    unsigned group = 0;
+
+    // Привязка шагов задачи к потоку пула. В режиме `affinity::hard` поток - `affinity_key` по модулю числа потоков,
+    // а `node` не учитывается
+    stepwise::affinity affinity = affinity::none;
+    std::size_t affinity_key = 0;
+
+    static submit_options on_node(int node) {
+        submit_options opts;
+        opts.node = node;
+        return opts;
+    }
+
+    static submit_options named(const char *name) {
+        submit_options opts;
+        opts.name = name;
+        return opts;
+    }
+
+    static submit_options stoppable(stop_token stop) {
+        submit_options opts;
+        opts.stop = std::move(stop);
+        return opts;
+    }
+
+    static submit_options with_deadline(std::chrono::steady_clock::time_point deadline) {
+        submit_options opts;
+        opts.deadline = deadline;
+        return opts;
+    }
+
+    static submit_options in_group(unsigned group) {
+        submit_options opts;
+        opts.group = group;
+        return opts;
+    }
+
+    static submit_options sticky() {
+        submit_options opts;
+        opts.affinity = affinity::soft;
+        return opts;
+    }
+
+    static submit_options pinned(std::size_t key) {
+        submit_options opts;
+        opts.affinity = affinity::hard;
+        opts.affinity_key = key;
+        return opts;
+    }
+};
+
+} // namespace stepwise
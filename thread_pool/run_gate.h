@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace stepwise {
+
+namespace detail {
+
+/**
+ * @brief Автомат запусков перезапускаемой задачи (`Task`, `shared_task`) на одном атомарном слове: фаза запуска и
+ * число читателей текущего запуска
+ *
+ * - `idle` - задача не запущена, `starting` - один поток ставит новый запуск и записывает его результат, `running` -
+ * запуск опубликован, к нему можно присоединиться. Завершение запуска возвращает задачу в `idle`
+ *
+ * - Читатель (присоединение в `share`, `kill`, проверка ожидающих) закрепляет слово, пока копирует результат
+ * запуска: новый запуск начинается только без читателей и не перезаписывает результат у них на глазах
+ *
+ * - Присоединение к выполняющейся задаче - один CAS и одно атомарное вычитание, без блокировок
+ */
+class run_gate {
+    static constexpr std::uint32_t idle = 0;
+    static constexpr std::uint32_t starting = 1;
+    static constexpr std::uint32_t running = 2;
+    static constexpr std::uint32_t phase_mask = 3;
+    static constexpr std::uint32_t finished_early = 4; // запуск завершился раньше, чем его опубликовали
+    static constexpr std::uint32_t reader = 8;
+
+    std::atomic<std::uint32_t> word{idle};
+
+  public:
+    enum class admission {
+        join,  // задача выполняется, читатель закреплён: скопируйте результат запуска и вызовите `unpin`
+        start, // задача не запущена, вызывающий поток ставит новый запуск и вызывает `started`
+        wait,  // другой поток ставит запуск либо уходят читатели прежнего, повторите попытку
+    };
+
+    admission enter() {
+        std::uint32_t current = word.load(std::memory_order_relaxed);
+
+        while (true) {
+            if ((current & phase_mask) == running) {
+                if (word.compare_exchange_weak(current, current + reader, std::memory_order_acquire,
+                                               std::memory_order_relaxed)) {
+                    return admission::join;
+                }
+            } else if (current == idle) {
+                if (word.compare_exchange_weak(current, starting, std::memory_order_acquire,
+                                               std::memory_order_relaxed)) {
+                    return admission::start;
+                }
+            } else {
+                return admission::wait;
+            }
+        }
+    }
+
+    /**
+     * @brief Закрепляет читателя опубликованного запуска, не начиная новый. Запуск, который сейчас ставится,
+     * дожидается
+     * @return `false`, если задача не выполняется
+     */
+    bool join() {
+        std::uint32_t current = word.load(std::memory_order_relaxed);
+
+        while (true) {
+            std::uint32_t phase = current & phase_mask;
+            if (phase == running) {
+                if (word.compare_exchange_weak(current, current + reader, std::memory_order_acquire,
+                                               std::memory_order_relaxed)) {
+                    return true;
+                }
+            } else if (phase == starting) {
+                std::this_thread::yield();
+                current = word.load(std::memory_order_relaxed);
+            } else {
+                return false;
+            }
+        }
+    }
+
+    /**
+     * @brief Публикует новый запуск: его результат записан. Если запуск уже успел завершиться (`complete`), задача
+     * сразу возвращается в `idle`
+     */
+    void started() {
+        std::uint32_t current = word.load(std::memory_order_relaxed);
+        while (!word.compare_exchange_weak(current, (current & finished_early) ? idle : running,
+                                           std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * @brief Отказ от запуска, например если постановка в пул выбросила исключение
+     */
+    void abandon() { word.store(idle, std::memory_order_release); }
+
+    /**
+     * @brief Запуск завершён, следующий `enter` начнёт новый. Читатели, закреплённые раньше, дочитывают прежний
+     */
+    void complete() {
+        std::uint32_t current = word.load(std::memory_order_relaxed);
+
+        while (true) {
+            std::uint32_t phase = current & phase_mask;
+            std::uint32_t next;
+            if (phase == running) {
+                next = current - running + idle;
+            } else if (phase == starting) {
+                next = current | finished_early;
+            } else {
+                return;
+            }
+
+            if (word.compare_exchange_weak(current, next, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief Закрепляет читателя в любой фазе, кроме `starting` (её дожидается). После чтения вызовите `unpin`
+     */
+    void pin() {
+        std::uint32_t current = word.load(std::memory_order_relaxed);
+
+        while (true) {
+            if ((current & phase_mask) == starting) {
+                std::this_thread::yield();
+                current = word.load(std::memory_order_relaxed);
+            } else if (word.compare_exchange_weak(current, current + reader, std::memory_order_acquire,
+                                                  std::memory_order_relaxed)) {
+                return;
+            }
+        }
+    }
+
+    void unpin() { word.fetch_sub(reader, std::memory_order_release); }
+
+    /**
+     * @brief Выполняется ли запуск (в том числе ставится прямо сейчас)
+     */
+    bool active() const { return (word.load(std::memory_order_acquire) & phase_mask) != idle; }
+};
+
+} // namespace detail
+
+} // namespace stepwise
@@ -1,21 +1,24 @@
 #pragma once
 
 #include <atomic>
-#include <future>
-#include <mutex>
 #include <memory>
+#include <thread>
 
+#include "coroutine.h"
 #include "fine_grained_thread_pool.h"
+#include "future.h"
+#include "run_gate.h"
 
 namespace stepwise {
 template <typename T> class shared_result;
 
 template <typename T> class shared_task : public std::enable_shared_from_this<shared_task<T>> {
 
-    std::atomic_bool is_valid{false};
+    // фаза запуска и читатели `future`/`reference_count`: присоединение к выполняющейся задаче без блокировок
+    detail::run_gate gate;
 
-    std::mutex result_mutex;
-    std::shared_future<T> future{};
+    // пишутся только в фазе `starting`, читаются под закреплением `gate`
+    shared_future<T> future{};
     std::shared_ptr<std::atomic_int> reference_count{new std::atomic_int{-1}};
 
     shared_task() {}
@@ -30,12 +33,17 @@ template <typename T> class shared_task : public std::enable_shared_from_this<sh
      *
      * - `false` задачу никто не ожидает
      */
-    bool does_it_expect() { return reference_count->load() >= 0; }
+    bool does_it_expect() {
+        gate.pin();
+        bool expects = reference_count->load() >= 0;
+        gate.unpin();
+        return expects;
+    }
 
     /**
      * @brief Сообщает о готовности задачи. Поместите Вызов этой функции в обработчик завершения задачи
      */
-    void notify_about_readiness() { is_valid.store(false); }
+    void notify_about_readiness() { gate.complete(); }
 
     /**
      * @brief Связать объект с задачей. Если текущая задача завершена, ставится новая задача, иначе возвращается
@@ -51,21 +59,36 @@ template <typename T> class shared_task : public std::enable_shared_from_this<sh
      */
     template <typename F, typename Cond, typename Notice>
     shared_result<T> share(std::shared_ptr<fine_grained_thread_pool> pool, F f, Cond c, Notice n) {
-        bool current = false;
-
-        std::lock_guard<std::mutex> lg{result_mutex};
-        if (is_valid.compare_exchange_strong(current, true)) {
-            reference_count = std::make_shared<std::atomic_int>(0);
-
-            future = pool->submit(std::move(f), std::move(c), std::move(n)).share();
-
-            auto res = shared_result<T>(reference_count, future);
-
-            reference_count->store(0);
-
-            return res;
-        } else {
-            return shared_result<T>(reference_count, future);
+        while (true) {
+            switch (gate.enter()) {
+            case detail::run_gate::admission::join: {
+                // задача выполняется: один CAS и увеличение счётчика ссылок
+                auto res = shared_result<T>(reference_count, future);
+                gate.unpin();
+                return res;
+            }
+
+            case detail::run_gate::admission::start: {
+                try {
+                    reference_count = std::make_shared<std::atomic_int>(0);
+
+                    future = pool->submit(std::move(f), std::move(c), std::move(n)).share();
+                } catch (...) {
+                    gate.abandon();
+                    throw;
+                }
+
+                auto res = shared_result<T>(reference_count, future);
+
+                reference_count->store(0);
+
+                gate.started();
+                return res;
+            }
+
+            case detail::run_gate::admission::wait:
+                std::this_thread::yield();
+            }
         }
     }
 
@@ -76,10 +99,10 @@ template <typename T> class shared_task : public std::enable_shared_from_this<sh
 template <typename T> class shared_result {
     friend class shared_task<T>;
 
-    std::shared_future<T> future{};
+    shared_future<T> future{};
     std::shared_ptr<std::atomic_int> reference_count;
 
-    shared_result(std::shared_ptr<std::atomic_int> ref_count, const std::shared_future<T> future) noexcept
+    shared_result(std::shared_ptr<std::atomic_int> ref_count, const shared_future<T> future) noexcept
         : reference_count(ref_count), future(future) {
         reference_count->fetch_add(1);
     }
@@ -126,12 +149,68 @@ template <typename T> class shared_result {
      *
      * - `false` - результат не готов
      */
-    bool try_get() { return (future.wait_for(std::chrono::milliseconds(0)) == std::future_status::ready); }
+    bool try_get() { return future.is_ready(); }
 
     const T &get() { return future.get(); }
 
+    /**
+     * @brief Итог задачи: значение, отмена или исключение. Для отменённой задачи исключение не выбрасывается
+     */
+    outcome<const T &> get_outcome() { return future.get_outcome(); }
+
+    /**
+     * @brief Продолжение: когда задача завершится, в пул `pool` будет поставлена задача `f(get())`. Поток при этом не
+     * блокируется. Пока продолжение не выполнено, оно считается ожидающим результат (`does_it_expect()`)
+     * @return `shared_future` результата `f`, у которого тоже есть `then`
+     */
+    template <typename F> auto then(const std::shared_ptr<fine_grained_thread_pool> &pool, F &&f) const {
+        return future.then(pool, [keep = *this, f = std::forward<F>(f)](const T &value) mutable { return f(value); });
+    }
+
     bool empty() { return reference_count.get() == nullptr; }
 
+    /**
+     * @brief Результат готов, когда завершены все задачи `results`. Ожидающий поток не нужен. Пока итоговый результат
+     * не готов, `results` считаются ожидающими (`does_it_expect()`)
+     * @return значения задач в порядке `results`
+     */
+    friend shared_future<std::vector<T>> when_all(const std::vector<shared_result<T>> &results) {
+        std::vector<shared_future<T>> futures;
+        for (auto &result : results) {
+            futures.push_back(result.future);
+        }
+
+        auto all = stepwise::when_all(futures);
+        all.on_ready([keep = results](const shared_future<std::vector<T>> &) {});
+        return all;
+    }
+
+    /**
+     * @brief Результат готов, как только завершена любая из задач `results`. Ожидающий поток не нужен. Копии `results`
+     * отпускаются сразу после готовности, поэтому проигравшие задачи, которых больше никто не ждёт, завершатся
+     * досрочно по своему условию `!does_it_expect()`
+     * @return номер первой завершившейся задачи и её значение
+     */
+    friend shared_future<when_any_result<T>> when_any(const std::vector<shared_result<T>> &results) {
+        std::vector<shared_future<T>> futures;
+        for (auto &result : results) {
+            futures.push_back(result.future);
+        }
+
+        auto any = stepwise::when_any(futures);
+        any.on_ready([keep = results](const shared_future<when_any_result<T>> &) {});
+        return any;
+    }
+
+#if STEPWISE_HAS_COROUTINES
+    /**
+     * @brief `co_await result` в корутине: поток не блокируется, корутина продолжится, когда задача завершится
+     */
+    friend detail::future_awaiter<T> operator co_await(const shared_result<T> &result) {
+        return detail::future_awaiter<T>{result.future};
+    }
+#endif
+
     const shared_result<T> &operator=(shared_result<T> other) {
         reference_count.swap(other.reference_count);
         std::swap(future, other.future);
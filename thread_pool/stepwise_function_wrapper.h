@@ -1,19 +1,19 @@
 #pragma once
 
+#include <chrono>
+#include <cstddef>
 #include <memory>
-#include <future>
 #include <optional>
 #include <exception>
 
-namespace stepwise {
-class bad_value : public std::exception {
-    std::string msg;
-
-  public:
-    bad_value(const std::string &message) : msg(message) {}
-    const char *what() const noexcept override { return msg.c_str(); }
-};
+#include "future.h"
+#include "pool_metrics.h"
+#include "pool_options.h"
+#include "stop_token.h"
+#include "task_status.h"
+#include "trace.h"
 
+namespace stepwise {
 class out_of_time : public std::exception {
     std::string msg;
 
@@ -30,14 +30,14 @@ class stepwise_function_wrapper;
 
 template <typename T> struct wrapped_function {
     std::shared_ptr<stepwise_function_wrapper> function{nullptr};
-    std::future<T> future{};
+    stepwise::future<T> future{};
 
     wrapped_function() {}
 
-    wrapped_function(std::shared_ptr<stepwise_function_wrapper> &function, std::future<T> &&future)
+    wrapped_function(std::shared_ptr<stepwise_function_wrapper> &function, stepwise::future<T> &&future)
         : function(function), future(std::move(future)) {}
 
-    wrapped_function(wrapped_function &&other) : function(other.function), future(std::move(future)) {}
+    wrapped_function(wrapped_function &&other) : function(other.function), future(std::move(other.future)) {}
 
     const wrapped_function &operator=(wrapped_function &&other) {
         std::swap(function, other.function);
@@ -53,99 +53,335 @@ template <typename T> struct wrapped_function {
 };
 
 class stepwise_function_wrapper {
-    struct impl_base {
-        virtual void step() = 0;
-        virtual bool is_done() = 0;
-        virtual ~impl_base() = default;
-    };
+  public:
+    // вызываемые объекты не больше этого размера хранятся внутри обёртки, без отдельного выделения памяти
+    static constexpr std::size_t inline_capacity = 64;
 
-    std::unique_ptr<impl_base> impl;
+  private:
+    // таблица функций для стирания типа impl_type: вместо виртуальных методов и отдельного объекта в куче
+    struct vtable {
+        stepwise::task_status (*step)(void *impl);
+        bool (*cancel_if_needed)(void *impl);
+        void (*cancel)(void *impl);
+        void (*move_to)(void *from, void *to) noexcept;
+        void (*destroy)(void *impl, bool on_heap) noexcept;
+    };
 
-    template <typename Cond, typename F, typename Notice> struct impl_type : impl_base {
+    template <typename Cond, typename F, typename Notice> struct impl_type {
         typedef typename std::result_of<F()>::type::value_type result_type;
         // класс является обёрткой над функцией, возвращающей std::optional. При этом если возвращается пустое значение,
-        // std::promise не устанавливается. Если возвращается не пустое значение, в std::promise устанавливается
+        // promise не устанавливается. Если возвращается не пустое значение, в promise устанавливается
         // std::optional::value
 
         F f_;
         Cond c_;
         Notice n_;
-        std::promise<result_type> promise;
-        std::atomic_bool done{false};
+        stepwise::promise<result_type> promise;
 
-        impl_type(std::promise<result_type> promise, Cond &&c, F &&f, Notice &&n)
+        impl_type(stepwise::promise<result_type> promise, Cond &&c, F &&f, Notice &&n)
             : f_(std::move(f)), c_(std::move(c)), n_(std::move(n)), promise(std::move(promise)) {}
 
-        void step() override {
+        stepwise::task_status step() {
             try {
                 std::optional<result_type> opt = f_();
                 if (opt.has_value()) {
-                    done = true;
                     n_();
-                    promise.set_value(opt.value());
+                    promise.set_value(std::move(*opt));
+                    return stepwise::task_status::completed;
                 }
             } catch (...) {
-                done = true;
                 n_();
                 promise.set_exception(std::current_exception());
+                return stepwise::task_status::failed;
             }
+
+            return stepwise::task_status::running;
         }
-        bool is_done() override {
-            if (done || c_()) {
-                if (!done) {
-                    n_();
-                    promise.set_exception(
-                        std::make_exception_ptr(stepwise::bad_value{"stepwise_function_wrapper: value is incomplete"}));
-                }
+
+        // отмена - обычный исход для пошаговых задач, поэтому исключение не создаётся: `get()` выбросит
+        // `bad_value` только тому, кто не проверяет `get_outcome()`
+        void cancel() {
+            n_();
+            promise.set_cancelled();
+        }
+
+        bool cancel_if_needed() {
+            if (c_()) {
+                cancel();
                 return true;
             }
 
             return false;
+        }
+
+        static constexpr bool fits_inline = sizeof(impl_type) <= inline_capacity &&
+                                            alignof(impl_type) <= alignof(std::max_align_t) &&
+                                            std::is_nothrow_move_constructible<impl_type>::value;
+
+        static constexpr vtable table{
+            [](void *impl) { return static_cast<impl_type *>(impl)->step(); },
+            [](void *impl) { return static_cast<impl_type *>(impl)->cancel_if_needed(); },
+            [](void *impl) { static_cast<impl_type *>(impl)->cancel(); },
+            [](void *from, void *to) noexcept {
+                new (to) impl_type(std::move(*static_cast<impl_type *>(from)));
+                static_cast<impl_type *>(from)->~impl_type();
+            },
+            [](void *impl, bool on_heap) noexcept {
+                if (on_heap) {
+                    delete static_cast<impl_type *>(impl);
+                } else {
+                    static_cast<impl_type *>(impl)->~impl_type();
+                }
+            },
         };
     };
 
+    alignas(std::max_align_t) unsigned char storage[inline_capacity];
+    void *impl{nullptr}; // указывает на `storage` либо на объект в куче, если он не поместился
+    const vtable *table{nullptr};
+
+    std::atomic<stepwise::task_status> status_{stepwise::task_status::running};
+
+    // кто владеет задачей: очередь пула, поток, выполняющий шаг, или никто (задача завершена). Переход из очереди
+    // в завершённые - отмена задачи, которую больше никто не ждёт, без участия потоков пула
+    enum phase : unsigned char { queued, stepping, finished };
+    std::atomic<unsigned char> phase_{queued};
+
+    stepwise::task_metrics metrics_{};
+
+    stepwise::task_trace trace_{};
+
+    stepwise::stop_token stop_{};
+
+    std::chrono::steady_clock::time_point deadline_{std::chrono::steady_clock::time_point::max()};
+
+    unsigned group_{0};
+
+    stepwise::affinity affinity_{stepwise::affinity::none};
+    unsigned worker_{0};
+
+    bool is_inline() const { return impl == static_cast<const void *>(storage); }
+
+    void reset() noexcept {
+        if (table) {
+            table->destroy(impl, !is_inline());
+        }
+        impl = nullptr;
+        table = nullptr;
+    }
+
+    void take(stepwise_function_wrapper &other) noexcept {
+        table = other.table;
+        if (other.is_inline()) {
+            impl = storage;
+            table->move_to(other.impl, impl);
+        } else {
+            impl = other.impl;
+        }
+
+        other.impl = nullptr;
+        other.table = nullptr;
+        status_ = other.status_.load();
+        phase_ = other.phase_.load();
+        metrics_ = other.metrics_;
+        trace_ = other.trace_;
+        stop_ = std::move(other.stop_);
+        deadline_ = other.deadline_;
+        group_ = other.group_;
+        affinity_ = other.affinity_;
+        worker_ = other.worker_;
+    }
+
   public:
     template <typename Cond, typename F, typename Notice>
-    stepwise_function_wrapper(std::promise<typename std::result_of<F()>::type::value_type> promise, Cond &&c, F &&f,
-                              Notice &&n)
-        : impl(new impl_type<Cond, F, Notice>(std::move(promise), std::move(c), std::move(f), std::move(n))) {}
+    stepwise_function_wrapper(stepwise::promise<typename std::result_of<F()>::type::value_type> promise, Cond &&c,
+                              F &&f, Notice &&n) {
+        using impl_t = impl_type<Cond, F, Notice>;
+
+        if constexpr (impl_t::fits_inline) {
+            impl = new (storage) impl_t(std::move(promise), std::move(c), std::move(f), std::move(n));
+        } else {
+            impl = new impl_t(std::move(promise), std::move(c), std::move(f), std::move(n));
+        }
+        table = &impl_t::table;
+    }
     stepwise_function_wrapper() = default;
     stepwise_function_wrapper(stepwise_function_wrapper &) = delete;
     stepwise_function_wrapper(const stepwise_function_wrapper &) = delete;
-    stepwise_function_wrapper(stepwise_function_wrapper &&other) : impl(std::move(other.impl)) {}
-    ~stepwise_function_wrapper() {}
+    stepwise_function_wrapper(stepwise_function_wrapper &&other) noexcept { take(other); }
+    ~stepwise_function_wrapper() { reset(); }
 
-    void operator()() { impl->step(); };
-    void step() { impl->step(); }
-    bool is_done() { return impl->is_done(); }
+    void operator()() { step(); };
+
+    void step() {
+        // после запроса остановки шаг не выполняется, задачу завершит `is_done`
+        if (status_ == stepwise::task_status::running && !stop_.stop_requested()) {
+            status_ = table->step(impl);
+        }
+    }
+
+    bool is_done() {
+        if (status_ != stepwise::task_status::running) {
+            return true;
+        }
+
+        if (stop_.stop_requested()) {
+            table->cancel(impl);
+            status_ = stepwise::task_status::cancelled;
+            return true;
+        }
+
+        if (table->cancel_if_needed(impl)) {
+            status_ = stepwise::task_status::cancelled;
+            return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Поток пула берёт задачу из очереди на шаг
+     * @return `false`, если задача уже завершена, пока ждала в очереди (`cancel_queued`). Такая запись очереди -
+     * надгробие: шаг не выполняется, задача просто выбрасывается
+     */
+    bool claim() {
+        unsigned char expected = queued;
+        return phase_.compare_exchange_strong(expected, stepping, std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Поток пула отдаёт задачу после шага `step()` и `is_done()`
+     * @param done Задача завершена и в очередь не вернётся
+     * @return `true`, если задача завершена: `done` либо остановка запрошена, пока шёл шаг, и задача отменена сразу
+     */
+    bool release(bool done) {
+        if (done) {
+            phase_.store(finished, std::memory_order_release);
+            return true;
+        }
+
+        phase_.store(queued, std::memory_order_release);
+        // парный барьер - в `result_state::request_stop`: либо отменяющий поток увидит задачу в очереди, либо этот
+        // поток увидит запрос остановки
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return stop_.stop_requested() && cancel_queued();
+    }
+
+    /**
+     * @brief Отменяет задачу, которая ждёт в очереди, в вызывающем потоке: обработчик завершения и отмена результата
+     * выполняются сразу, а запись в очереди становится надгробием
+     * @return `false`, если задачу сейчас выполняет поток пула (он отменит её сам после шага) или она уже завершена
+     */
+    bool cancel_queued() {
+        unsigned char expected = queued;
+        if (!phase_.compare_exchange_strong(expected, finished, std::memory_order_acq_rel)) {
+            return false;
+        }
+
+        table->cancel(impl);
+        status_ = stepwise::task_status::cancelled;
+        return true;
+    }
+
+    // `cancel_queued` для `result_state::set_canceller`
+    static bool cancel_queued(void *task) { return static_cast<stepwise_function_wrapper *>(task)->cancel_queued(); }
+
+    /**
+     * @brief Состояние задачи: выполняется, вернула значение, выбросила исключение или завершена по `cond()`
+     */
+    stepwise::task_status status() { return status_; }
+
+    /**
+     * @brief Хранится ли вызываемый объект внутри обёртки (без выделения памяти в куче)
+     */
+    bool is_stored_inline() const { return impl && is_inline(); }
+
+    stepwise::task_metrics &metrics() { return metrics_; }
+
+    stepwise::task_trace &trace() { return trace_; }
+
+    /**
+     * @brief Связывает задачу с токеном отмены. Запрос остановки проверяется одной атомарной загрузкой перед шагом
+     * и после него, раньше `cond()`
+     */
+    void set_stop_token(stepwise::stop_token token) { stop_ = std::move(token); }
+
+    /**
+     * @brief Срок, к которому задача должна завершиться. `time_point::max()` - срока нет
+     */
+    std::chrono::steady_clock::time_point deadline() const { return deadline_; }
+
+    void set_deadline(std::chrono::steady_clock::time_point deadline) { deadline_ = deadline; }
+
+    /**
+     * @brief Группа задачи (арендатор), которой засчитывается время её шагов
+     */
+    unsigned group() const { return group_; }
+
+    void set_group(unsigned group) { group_ = group; }
+
+    /**
+     * @brief Привязка шагов задачи к потоку пула и номер этого потока: закреплённого (`affinity::hard`) либо
+     * выполнившего последний шаг (`affinity::soft`)
+     */
+    stepwise::affinity affinity() const { return affinity_; }
+
+    unsigned worker() const { return worker_; }
+
+    void set_affinity(stepwise::affinity affinity, unsigned worker) {
+        affinity_ = affinity;
+        worker_ = worker;
+    }
 
     stepwise_function_wrapper &operator=(const stepwise_function_wrapper &) = delete;
-    stepwise_function_wrapper &operator=(stepwise_function_wrapper &&other) {
-        impl = std::move(other.impl);
+    stepwise_function_wrapper &operator=(stepwise_function_wrapper &&other) noexcept {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
         return *this;
     }
 
-    template <typename Callable, typename BoolFunc, typename Notice>
-    static auto wrap(Callable &&f, BoolFunc &&cond, Notice &&n) {
+    /**
+     * @brief Тип значения задачи `f`: `T` для `f`, возвращающей `std::optional<T>` или просто `T`
+     */
+    template <typename Callable> struct value_of {
+        typedef typename std::result_of<Callable()>::type result_type;
+        typedef typename std::conditional_t<isOptional<result_type>::value, result_type, std::optional<result_type>>::
+            value_type type;
+    };
+
+    /**
+     * @brief Оборачивает задачу, результат которой будет записан в уже существующий `promise`
+     */
+    template <typename ResultType, typename Callable, typename BoolFunc, typename Notice>
+    static std::shared_ptr<stepwise_function_wrapper> wrap_with_promise(stepwise::promise<ResultType> promise,
+                                                                        Callable &&f, BoolFunc &&cond, Notice &&n) {
         typedef typename std::result_of<Callable()>::type result_type;
+        static_assert(std::is_same<typename value_of<Callable>::type, ResultType>::value,
+                      "stepwise_function_wrapper: callable result does not match the promise");
+
         if constexpr (isOptional<result_type>::value) {
-            std::promise<typename result_type::value_type> promise;
-            std::future<typename result_type::value_type> result(promise.get_future());
-            auto task = std::make_shared<stepwise_function_wrapper>(
+            return std::make_shared<stepwise_function_wrapper>(
                 std::move(promise), std::move(cond),
-                std::move([func = std::move(f)]() mutable -> std::optional<typename result_type::value_type> {
-                    return func();
-                }),
-                std::move(n));
-            return wrapped_function<typename result_type::value_type>(task, std::move(result));
+                [func = std::move(f)]() mutable -> std::optional<ResultType> { return func(); }, std::move(n));
         } else {
-            std::promise<result_type> promise;
-            std::future<result_type> result(promise.get_future());
-            auto task = std::make_shared<stepwise_function_wrapper>(
+            return std::make_shared<stepwise_function_wrapper>(
                 std::move(promise), std::move(cond),
-                std::move([f]() mutable -> std::optional<result_type> { return std::optional<result_type>{f()}; }),
+                [func = std::move(f)]() mutable -> std::optional<ResultType> {
+                    return std::optional<ResultType>{func()};
+                },
                 std::move(n));
-            return wrapped_function<result_type>(task, std::move(result));
         }
     }
+
+    template <typename Callable, typename BoolFunc, typename Notice>
+    static auto wrap(Callable &&f, BoolFunc &&cond, Notice &&n) {
+        typedef typename value_of<Callable>::type value_type;
+
+        stepwise::promise<value_type> promise;
+        stepwise::future<value_type> result(promise.get_future());
+        auto task = wrap_with_promise(std::move(promise), std::move(f), std::move(cond), std::move(n));
+        return wrapped_function<value_type>(task, std::move(result));
+    }
 };
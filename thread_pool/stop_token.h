@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#if __cplusplus >= 202002L && __has_include(<stop_token>)
+#include <stop_token>
+#endif
+
+namespace stepwise {
+
+#if defined(__cpp_lib_jthread)
+
+using stop_token = std::stop_token;
+using stop_source = std::stop_source;
+using std::nostopstate;
+using std::nostopstate_t;
+
+#else
+
+struct nostopstate_t {
+    explicit nostopstate_t() = default;
+};
+
+// `stop_source(nostopstate)` - источник без состояния, создаётся без выделения памяти
+inline constexpr nostopstate_t nostopstate{};
+
+/**
+ * @brief Замена `std::stop_token` для C++17: позволяет узнать, запрошена ли остановка у связанного `stop_source`.
+ * Поддерживается только общая с `std::stop_token` часть интерфейса, без `std::stop_callback`
+ */
+class stop_token {
+    friend class stop_source;
+
+    std::shared_ptr<std::atomic_bool> state{};
+
+    explicit stop_token(std::shared_ptr<std::atomic_bool> state) : state(std::move(state)) {}
+
+  public:
+    stop_token() noexcept = default;
+
+    /**
+     * @brief Связан ли токен с `stop_source`. Токен по умолчанию никогда не будет остановлен
+     */
+    bool stop_possible() const noexcept { return (bool) state; }
+
+    bool stop_requested() const noexcept { return state && state->load(std::memory_order_acquire); }
+};
+
+/**
+ * @brief Замена `std::stop_source` для C++17: запрашивает остановку у всех связанных `stop_token`
+ */
+class stop_source {
+    std::shared_ptr<std::atomic_bool> state{std::make_shared<std::atomic_bool>(false)};
+
+  public:
+    stop_source() = default;
+
+    explicit stop_source(nostopstate_t) noexcept : state() {}
+
+    /**
+     * @return `true`, если остановка запрошена этим вызовом, `false`, если она уже была запрошена раньше или у
+     * источника нет состояния
+     */
+    bool request_stop() noexcept { return state && !state->exchange(true, std::memory_order_acq_rel); }
+
+    bool stop_requested() const noexcept { return state && state->load(std::memory_order_acquire); }
+
+    bool stop_possible() const noexcept { return (bool) state; }
+
+    stop_token get_token() const noexcept { return stop_token(state); }
+};
+
+#endif
+
+} // namespace stepwise
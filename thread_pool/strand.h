@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "fine_grained_thread_pool.h"
+#include "future.h"
+#include "stepwise_function_wrapper.h"
+
+namespace stepwise {
+
+/**
+ * @brief Последовательный исполнитель поверх `fine_grained_thread_pool`
+ *
+ * - Задачи одного `strand` выполняются по одной в порядке `post`, задачи разных `strand` - параллельно. Взаимное
+ * исключение обеспечивается порядком, а не блокировками: потоки пула не ждут друг друга
+ *
+ * - Очередь `strand` - список без блокировок (много писателей, один читатель). Первая задача в пустой очереди ставит
+ * в пул пошаговую задачу-обработчик, которая выполняет очередь и завершается, когда очередь опустела. Отдельного
+ * потока у `strand` нет
+ *
+ * - Копии `strand` ссылаются на одну и ту же очередь
+ */
+class strand {
+    // за один шаг обработчик выполняет не больше стольких задач, затем уступает поток другим задачам пула
+    static constexpr int batch = 16;
+
+    struct item {
+        std::atomic<item *> next{nullptr};
+
+        virtual ~item() = default;
+
+        // выполняет шаг задачи; `true`, если задача завершена
+        virtual bool step() { return true; }
+    };
+
+    template <typename F, typename R> struct task_item : item {
+        std::optional<F> f;
+        promise<R> result;
+
+        task_item(F &&f) : f(std::move(f)) {}
+
+        bool step() override {
+            try {
+                if constexpr (isOptional<std::invoke_result_t<F &>>::value) {
+                    auto value = (*f)();
+                    if (!value.has_value()) {
+                        return false;
+                    }
+                    result.set_value(std::move(*value));
+                } else {
+                    result.set_value((*f)());
+                }
+            } catch (...) {
+                result.set_exception(std::current_exception());
+            }
+
+            f.reset(); // захваченные задачей объекты не должны жить до следующей задачи
+            return true;
+        }
+    };
+
+    struct state {
+        fine_grained_thread_pool *pool;
+        submit_options opts;
+
+        item stub;
+        std::atomic<item *> head{&stub}; // последняя добавленная задача, сюда пишут `post`
+        item *tail{&stub};               // уже выполненная задача, следующая за ней - очередная. Только обработчик
+
+        std::atomic<std::size_t> pending{0}; // задачи, добавленные, но ещё не выполненные
+
+        state(fine_grained_thread_pool &pool, submit_options opts) : pool(&pool), opts(opts) {}
+
+        ~state() {
+            for (item *node = tail; node;) {
+                item *next = node->next.load();
+                if (node != &stub) {
+                    delete node;
+                }
+                node = next;
+            }
+        }
+
+        void push(item *node) {
+            item *prev = head.exchange(node, std::memory_order_acq_rel);
+            prev->next.store(node, std::memory_order_release);
+        }
+
+        // вызывается обработчиком, когда `pending > 0`
+        item *front() {
+            item *next;
+            // писатель мог уже занять место в очереди, но ещё не связать его с предыдущим
+            while (!(next = tail->next.load(std::memory_order_acquire))) {
+                std::this_thread::yield();
+            }
+            return next;
+        }
+
+        void pop() {
+            item *next = tail->next.load(std::memory_order_relaxed);
+            if (tail != &stub) {
+                delete tail;
+            }
+            tail = next;
+        }
+    };
+
+    std::shared_ptr<state> s;
+
+    static void schedule(const std::shared_ptr<state> &s) {
+        s->pool->submit(
+            [s]() -> std::optional<bool> {
+                for (int i = 0; i < batch; ++i) {
+                    if (!s->front()->step()) {
+                        return {}; // пошаговая задача не завершена, `strand` остаётся на ней
+                    }
+                    s->pop();
+
+                    if (s->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        return true; // очередь пуста, следующий `post` поставит новый обработчик
+                    }
+                }
+                return {};
+            },
+            s->opts);
+    }
+
+  public:
+    /**
+     * @param pool Пул, в котором выполняются задачи. Должен жить, пока в `strand` есть задачи
+     * @param opts Параметры постановки обработчика в пул (узел, имя в трассе)
+     */
+    explicit strand(fine_grained_thread_pool &pool, submit_options opts = {})
+        : s(std::make_shared<state>(pool, opts)) {}
+
+    /**
+     * @brief Добавляет задачу в конец очереди `strand`
+     * @param f Вызываемый объект, возвращающий `std::optional<T>` (пошаговая задача: пока значения нет, следующие
+     * задачи `strand` ждут) либо просто `T`
+     * @return `stepwise::future<T>` результата задачи
+     */
+    template <typename F> auto post(F f) {
+        using value_type = typename stepwise_function_wrapper::value_of<F>::type;
+
+        auto node = new task_item<F, value_type>(std::move(f));
+        future<value_type> result = node->result.get_future();
+
+        s->push(node);
+        if (s->pending.fetch_add(1, std::memory_order_acq_rel) == 0) {
+            schedule(s);
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Количество задач, добавленных, но ещё не выполненных
+     */
+    std::size_t pending() const { return s->pending.load(std::memory_order_relaxed); }
+};
+
+} // namespace stepwise
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+
+#include "../connection/IConnection.h"
+#include "fine_grained_thread_pool.h"
+#include "future.h"
+
+namespace stepwise {
+
+/**
+ * @brief Ставит в пул пошаговую задачу, которая по ходу выполнения публикует частичные результаты в соединение `tx`
+ *
+ * - Каждый шаг вызывает `f(*tx)`: шаг отправляет готовые данные через `tx->send(...)` и возвращает пустой
+ * `std::optional`, если задача не закончена. Получатели `tx` обрабатывают частичные результаты, пока задача
+ * выполняет оставшиеся шаги
+ *
+ * - Когда задача завершена (значением, исключением или досрочно по `cond()`), `tx` закрывается до того, как станет
+ * готов её результат: получатель видит все частичные результаты, затем конец данных (`receive()` выбрасывает
+ * исключение, `waitAndReceive()` больше не ждёт)
+ *
+ * - Если получатель не успевает за задачей, поведение определяется соединением, например `QueueConnectionSender`
+ * вытесняет самые старые данные
+ * @param tx Соединение для частичных результатов, наследник `IConnectionSender<P>`. Задача закрывает его, поэтому
+ * не передавайте отправителя, которым пользуется кто-то ещё: сделайте ему `copy()`
+ * @param f Вызываемый объект `std::optional<T>(IConnectionSender<P> &)` (либо `T(IConnectionSender<P> &)`)
+ * @param cond Вызываемый объект, возвращающий `bool` - условие досрочного завершения задачи
+ * @return `stepwise::future<T>` итогового результата задачи
+ */
+template <typename Sender, typename F, typename Cond>
+auto submit_streaming(fine_grained_thread_pool &pool, std::shared_ptr<Sender> tx, F f, Cond cond,
+                      submit_options opts = {}) {
+    auto step = [tx, f = std::move(f)]() mutable { return f(*tx); };
+    return pool.submit(std::move(step), std::move(cond), [tx]() { tx->close(); }, opts);
+}
+
+template <typename Sender, typename F>
+auto submit_streaming(fine_grained_thread_pool &pool, std::shared_ptr<Sender> tx, F f, submit_options opts = {}) {
+    return submit_streaming(pool, std::move(tx), std::move(f), []() { return false; }, opts);
+}
+
+} // namespace stepwise
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "fine_grained_thread_pool.h"
+#include "future.h"
+#include "stepwise_function_wrapper.h"
+
+namespace stepwise {
+
+class task_graph;
+
+namespace detail {
+
+struct graph_run;
+
+/**
+ * @brief Вершина графа без типа значения: рёбра и счётчик невыполненных предшественников
+ */
+struct graph_vertex_base {
+    std::vector<graph_vertex_base *> successors;
+    std::size_t predecessors = 0;
+    std::atomic<std::size_t> pending{0}; // предшественники, не завершившиеся в текущем прогоне
+    std::atomic_bool skipped{false};     // предшественник выбросил исключение или сам был пропущен
+
+    virtual ~graph_vertex_base() = default;
+
+    // забывает значение прошлого прогона
+    virtual void reset() = 0;
+
+    // ставит вершину в пул
+    virtual void submit(const std::shared_ptr<graph_run> &run) = 0;
+
+    // вызывается потоком пула, когда вершина выполнена (`ok`) либо выбросила исключение или пропущена
+    void finish(const std::shared_ptr<graph_run> &run, bool ok);
+};
+
+/**
+ * @brief Состояние одного прогона графа. Держит вершины, пока выполняется хотя бы одна из них
+ */
+struct graph_run {
+    fine_grained_thread_pool *pool;
+    std::vector<std::shared_ptr<graph_vertex_base>> vertices;
+    std::shared_ptr<std::atomic_bool> running;
+    std::size_t number;
+
+    std::atomic<std::size_t> remaining{0};
+
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    promise<std::size_t> done;
+
+    void fail(std::exception_ptr e) {
+        std::lock_guard<std::mutex> lg{error_mutex};
+        if (!error) {
+            error = e;
+        }
+    }
+
+    void complete() {
+        // граф можно запускать снова уже из продолжения результата прогона
+        running->store(false);
+
+        if (error) {
+            done.set_exception(error);
+        } else {
+            done.set_value(number);
+        }
+    }
+};
+
+inline void graph_vertex_base::finish(const std::shared_ptr<graph_run> &run, bool ok) {
+    for (auto *successor : successors) {
+        if (!ok) {
+            successor->skipped.store(true, std::memory_order_relaxed);
+        }
+        if (successor->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            successor->submit(run);
+        }
+    }
+
+    if (run->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        run->complete();
+    }
+}
+
+template <typename T> struct graph_vertex : graph_vertex_base {
+    std::function<std::optional<T>()> body;
+    std::optional<T> value;
+
+    graph_vertex(std::function<std::optional<T>()> body) : body(std::move(body)) {}
+
+    void reset() override { value.reset(); }
+
+    void submit(const std::shared_ptr<graph_run> &run) override {
+        // у каждого прогона своя копия `body`: состояние пошаговой задачи не переходит в следующий прогон
+        run->pool->submit([this, run, body = body]() mutable -> std::optional<bool> {
+            bool ok = !skipped.load(std::memory_order_relaxed);
+
+            if (ok) {
+                try {
+                    std::optional<T> result = body();
+                    if (!result.has_value()) {
+                        return {};
+                    }
+                    value = std::move(result);
+                } catch (...) {
+                    run->fail(std::current_exception());
+                    ok = false;
+                }
+            }
+
+            finish(run, ok);
+            return true;
+        });
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief Вершина `task_graph`. Через неё задаются рёбра и читается значение последнего прогона
+ */
+template <typename T> class graph_node {
+    friend class task_graph;
+
+    std::shared_ptr<detail::graph_vertex<T>> vertex;
+
+    graph_node(std::shared_ptr<detail::graph_vertex<T>> vertex) : vertex(std::move(vertex)) {}
+
+  public:
+    graph_node() = default;
+
+    /**
+     * @brief Есть ли у вершины значение, вычисленное в последнем прогоне
+     */
+    bool has_value() const { return vertex && vertex->value.has_value(); }
+
+    /**
+     * @brief Значение вершины, вычисленное в последнем прогоне. Читайте после готовности результата `run`
+     * @throw `std::bad_optional_access`, если вершина не выполнялась (например, прогон завершился ошибкой)
+     */
+    const T &get() const { return vertex->value.value(); }
+};
+
+/**
+ * @brief Граф зависимостей задач (DAG), выполняемый в `fine_grained_thread_pool`
+ *
+ * - Вершина - вызываемый объект. Если он возвращает `std::optional<T>`, вершина пошаговая: пул возвращается к ней,
+ * пока не появится значение. Значения предшественников, перечисленных в `emplace`, передаются в вызываемый объект
+ * аргументами
+ *
+ * - Вершина ставится в пул, как только завершились все её предшественники: у каждой вершины атомарный счётчик, и
+ * последний завершившийся предшественник ставит её в очередь. Ни один поток не ждёт другую задачу
+ *
+ * - Граф можно запускать повторно, не перестраивая. Одновременно выполняется не больше одного прогона
+ */
+class task_graph {
+    std::vector<std::shared_ptr<detail::graph_vertex_base>> vertices;
+    std::shared_ptr<std::atomic_bool> running{std::make_shared<std::atomic_bool>(false)};
+    std::size_t runs = 0;
+    bool checked = true; // после `precede` граф проверяется на циклы при следующем запуске
+
+    void check_not_running() const {
+        if (running->load()) {
+            throw std::logic_error("task_graph: graph cannot be changed while it is running");
+        }
+    }
+
+    bool has_cycle() const {
+        std::unordered_map<const detail::graph_vertex_base *, std::size_t> indegree;
+        std::vector<const detail::graph_vertex_base *> ready;
+
+        for (auto &vertex : vertices) {
+            indegree[vertex.get()] = vertex->predecessors;
+            if (vertex->predecessors == 0) {
+                ready.push_back(vertex.get());
+            }
+        }
+
+        std::size_t visited = 0;
+        while (!ready.empty()) {
+            const detail::graph_vertex_base *vertex = ready.back();
+            ready.pop_back();
+            ++visited;
+
+            for (auto *successor : vertex->successors) {
+                if (--indegree[successor] == 0) {
+                    ready.push_back(successor);
+                }
+            }
+        }
+
+        return visited != vertices.size();
+    }
+
+  public:
+    task_graph() = default;
+    task_graph(const task_graph &) = delete;
+    task_graph &operator=(const task_graph &) = delete;
+
+    /**
+     * @brief Добавляет вершину `f(inputs.get()...)`, зависящую от вершин `inputs`
+     * @param f Вызываемый объект, возвращающий `std::optional<T>` (пошаговая вершина) либо просто `T`. Копируется в
+     * каждый прогон
+     * @return `graph_node<T>`
+     * @throw `std::logic_error`, если граф сейчас выполняется
+     */
+    template <typename F, typename... Inputs> auto emplace(F f, const graph_node<Inputs> &...inputs) {
+        using result_type = std::invoke_result_t<F &, const Inputs &...>;
+        using value_type =
+            typename std::conditional_t<isOptional<result_type>::value, result_type, std::optional<result_type>>::
+                value_type;
+
+        check_not_running();
+
+        auto body = [f = std::move(f), in = std::make_tuple(inputs.vertex...)]() mutable -> std::optional<value_type> {
+            return std::apply([&f](auto &...vertex) -> std::optional<value_type> { return f(*vertex->value...); }, in);
+        };
+
+        auto vertex = std::make_shared<detail::graph_vertex<value_type>>(std::move(body));
+        (inputs.vertex->successors.push_back(vertex.get()), ...);
+        vertex->predecessors = sizeof...(Inputs);
+        vertices.push_back(vertex);
+
+        return graph_node<value_type>(vertex);
+    }
+
+    /**
+     * @brief Добавляет ребро без передачи значения: `to` выполнится только после `from`
+     * @throw `std::logic_error`, если граф сейчас выполняется
+     */
+    template <typename T, typename U> void precede(const graph_node<T> &from, const graph_node<U> &to) {
+        check_not_running();
+
+        from.vertex->successors.push_back(to.vertex.get());
+        ++to.vertex->predecessors;
+        checked = false;
+    }
+
+    std::size_t size() const { return vertices.size(); }
+
+    /**
+     * @brief Запускает граф в пуле `pool`: в очередь сразу попадают вершины без предшественников. Пул должен жить до
+     * готовности результата
+     * @return номер прогона (начиная с 1), когда выполнены все вершины. Если вершина выбросила исключение, её
+     * потомки не выполняются, остальные вершины выполняются как обычно, а результат содержит первое исключение
+     * @throw `std::logic_error`, если граф уже выполняется или в нём есть цикл
+     */
+    shared_future<std::size_t> run(fine_grained_thread_pool &pool) {
+        bool expected = false;
+        if (!running->compare_exchange_strong(expected, true)) {
+            throw std::logic_error("task_graph: graph is already running");
+        }
+
+        if (!checked) {
+            if (has_cycle()) {
+                running->store(false);
+                throw std::logic_error("task_graph: graph has a cycle");
+            }
+            checked = true;
+        }
+
+        auto run = std::make_shared<detail::graph_run>();
+        run->pool = &pool;
+        run->vertices = vertices;
+        run->running = running;
+        run->number = ++runs;
+        run->remaining.store(vertices.size());
+
+        shared_future<std::size_t> result = run->done.get_future().share();
+
+        if (vertices.empty()) {
+            run->complete();
+            return result;
+        }
+
+        for (auto &vertex : vertices) {
+            vertex->reset();
+            vertex->skipped.store(false, std::memory_order_relaxed);
+            vertex->pending.store(vertex->predecessors, std::memory_order_relaxed);
+        }
+
+        for (auto &vertex : run->vertices) {
+            if (vertex->predecessors == 0) {
+                vertex->submit(run);
+            }
+        }
+
+        return result;
+    }
+};
+
+} // namespace stepwise
@@ -0,0 +1,15 @@
+#pragma once
+
+namespace stepwise {
+
+/**
+ * @brief Состояние задачи в пуле потоков
+ */
+enum class task_status {
+    running = 0,   // задача ещё выполняется
+    completed = 1, // задача вернула значение
+    failed = 2,    // задача выбросила исключение
+    cancelled = 3, // задача завершена досрочно по `cond()`
+};
+
+} // namespace stepwise
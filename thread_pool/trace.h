@@ -0,0 +1,285 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace stepwise {
+
+/**
+ * @brief Сведения о задаче для трассировки: идентификатор и имя, заданное пользователем
+ */
+struct task_trace {
+    std::uint64_t id = 0; // 0 - задача не трассируется
+    const char *name = nullptr;
+};
+
+/**
+ * @brief Трассировка выполнения задач в пулах потоков
+ *
+ * - События (постановка задачи, начало и конец шага, завершение) пишутся в буферы потоков без блокировок: у каждого
+ * потока свой буфер, читатель видит только опубликованные записи
+ *
+ * - `write_chrome_trace` забирает накопленные события и записывает их в формате Chrome trace event, который
+ * открывается в `chrome://tracing` и Perfetto
+ *
+ * - Пока трассировка выключена, пул платит за неё одной relaxed-загрузкой флага на шаг
+ */
+class tracer {
+  public:
+    enum class event_type : std::uint8_t { submit, step_begin, step_end, complete };
+
+    struct event {
+        std::int64_t timestamp_ns;
+        std::uint64_t task;
+        const char *name;
+        std::uint32_t pool;
+        std::int32_t worker; // -1 - поток не принадлежит пулу
+        event_type type;
+    };
+
+  private:
+    static constexpr std::size_t chunk_capacity = 4096;
+
+    struct chunk {
+        event events[chunk_capacity];
+        std::atomic<std::size_t> size{0};
+        std::atomic<chunk *> next{nullptr};
+    };
+
+    // буфер одного потока: односвязный список блоков. Пишет только владелец, читает только `write_chrome_trace`
+    struct thread_buffer {
+        chunk *head;                  // первый непрочитанный блок, принадлежит читателю
+        std::size_t read_position{0}; // сколько событий `head` уже прочитано
+        chunk *tail;                  // блок, в который пишет владелец
+        std::uint32_t thread_number;
+        std::atomic_bool retired{false};
+
+        thread_buffer(std::uint32_t number) : head(new chunk), tail(head), thread_number(number) {}
+
+        ~thread_buffer() {
+            while (head) {
+                chunk *next = head->next.load();
+                delete head;
+                head = next;
+            }
+        }
+
+        void push(const event &e) {
+            std::size_t size = tail->size.load(std::memory_order_relaxed);
+
+            if (size == chunk_capacity) {
+                chunk *fresh = new chunk;
+                tail->next.store(fresh, std::memory_order_release);
+                tail = fresh;
+                size = 0;
+            }
+
+            tail->events[size] = e;
+            tail->size.store(size + 1, std::memory_order_release);
+        }
+    };
+
+    // при завершении потока помечает его буфер, чтобы читатель освободил его после вычитывания
+    struct buffer_owner {
+        thread_buffer *buffer = nullptr;
+
+        ~buffer_owner() {
+            if (buffer) {
+                buffer->retired.store(true, std::memory_order_release);
+            }
+        }
+    };
+
+    struct state {
+        std::atomic_bool enabled{false};
+        std::atomic<std::uint64_t> next_task{1};
+        std::atomic<std::uint32_t> next_pool{1};
+        std::chrono::steady_clock::time_point epoch{std::chrono::steady_clock::now()};
+
+        std::mutex buffers_mutex;
+        std::vector<std::unique_ptr<thread_buffer>> buffers;
+        std::uint32_t next_thread{0};
+
+        std::mutex names_mutex;
+        std::unordered_set<std::string> names;
+    };
+
+    static state &instance() {
+        static state s;
+        return s;
+    }
+
+    static thread_buffer &this_thread_buffer() {
+        static thread_local buffer_owner owner;
+
+        if (!owner.buffer) {
+            auto &s = instance();
+            std::lock_guard<std::mutex> lg{s.buffers_mutex};
+            s.buffers.push_back(std::make_unique<thread_buffer>(s.next_thread++));
+            owner.buffer = s.buffers.back().get();
+        }
+
+        return *owner.buffer;
+    }
+
+    static void write_escaped(std::ostream &out, const char *str) {
+        for (; *str; ++str) {
+            unsigned char c = (unsigned char) *str;
+            if (c == '"' || c == '\\') {
+                out << '\\' << (char) c;
+            } else if (c < 0x20) {
+                static const char hex[] = "0123456789abcdef";
+                out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+            } else {
+                out << (char) c;
+            }
+        }
+    }
+
+    static void write_event(std::ostream &out, const event &e, std::uint32_t thread_number, bool &first) {
+        static const char *phases[] = {"i", "B", "E", "i"};
+        static const char *kinds[] = {"submit", "step", "step", "complete"};
+
+        out << (first ? "\n" : ",\n");
+        first = false;
+
+        out << "{\"name\":\"";
+        if (e.type == event_type::step_begin || e.type == event_type::step_end) {
+            if (e.name) {
+                write_escaped(out, e.name);
+            } else {
+                out << "task " << e.task;
+            }
+        } else {
+            out << kinds[(int) e.type];
+        }
+
+        // потоки пула нумеруются как в пуле, остальные потоки - после них
+        std::int64_t tid = (e.worker >= 0) ? e.worker : 100000 + (std::int64_t) thread_number;
+
+        out << "\",\"cat\":\"" << kinds[(int) e.type] << "\",\"ph\":\"" << phases[(int) e.type] << "\"";
+        if (e.type == event_type::submit || e.type == event_type::complete) {
+            out << ",\"s\":\"t\"";
+        }
+        // формат требует микросекунды, дробная часть сохраняет точность до наносекунды
+        char fraction[4] = {(char) ('0' + e.timestamp_ns % 1000 / 100), (char) ('0' + e.timestamp_ns % 100 / 10),
+                            (char) ('0' + e.timestamp_ns % 10), '\0'};
+        out << ",\"ts\":" << e.timestamp_ns / 1000 << "." << fraction << ",\"pid\":" << e.pool << ",\"tid\":" << tid
+            << ",\"args\":{\"task\":" << e.task;
+        if (e.name) {
+            out << ",\"task_name\":\"";
+            write_escaped(out, e.name);
+            out << "\"";
+        }
+        out << "}}";
+    }
+
+  public:
+    /**
+     * @brief Включает запись событий
+     */
+    static void start() { instance().enabled.store(true, std::memory_order_relaxed); }
+
+    /**
+     * @brief Выключает запись событий. Накопленные события остаются до вызова `write_chrome_trace`
+     */
+    static void stop() { instance().enabled.store(false, std::memory_order_relaxed); }
+
+    static bool enabled() { return instance().enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Возвращает строку с тем же содержимым, что `name`, которая живёт до конца программы. Используйте для
+     * имён задач, собранных во время выполнения
+     */
+    static const char *intern(const std::string &name) {
+        auto &s = instance();
+        std::lock_guard<std::mutex> lg{s.names_mutex};
+        return s.names.insert(name).first->c_str();
+    }
+
+    static std::uint64_t next_task_id() { return instance().next_task.fetch_add(1, std::memory_order_relaxed); }
+
+    static std::uint32_t next_pool_id() { return instance().next_pool.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * @brief Записывает событие в буфер вызывающего потока
+     */
+    static void record(event_type type, std::uint32_t pool, int worker, const task_trace &task) {
+        auto &s = instance();
+        auto ts = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s.epoch);
+
+        this_thread_buffer().push({ts.count(), task.id, task.name, pool, worker, type});
+    }
+
+    /**
+     * @brief Забирает все опубликованные события и записывает их в `out` в формате Chrome trace event (JSON)
+     * @return количество записанных событий
+     */
+    static std::size_t write_chrome_trace(std::ostream &out) {
+        auto &s = instance();
+        std::lock_guard<std::mutex> lg{s.buffers_mutex};
+
+        std::size_t written = 0;
+        bool first = true;
+
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+        for (auto it = s.buffers.begin(); it != s.buffers.end();) {
+            thread_buffer &buffer = **it;
+            // признак читается до событий: если поток уже завершился, все его события опубликованы
+            bool retired = buffer.retired.load(std::memory_order_acquire);
+
+            while (true) {
+                std::size_t size = buffer.head->size.load(std::memory_order_acquire);
+
+                for (; buffer.read_position < size; ++buffer.read_position, ++written) {
+                    write_event(out, buffer.head->events[buffer.read_position], buffer.thread_number, first);
+                }
+
+                chunk *next = buffer.head->next.load(std::memory_order_acquire);
+                if (!next || size != chunk_capacity) {
+                    break;
+                }
+
+                // владелец уже пишет в следующий блок, прочитанный можно освободить
+                delete buffer.head;
+                buffer.head = next;
+                buffer.read_position = 0;
+            }
+
+            if (retired) {
+                it = s.buffers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        out << "\n]}\n";
+
+        return written;
+    }
+
+    /**
+     * @brief Записывает накопленные события в файл `path`
+     * @return `false`, если файл не удалось открыть
+     */
+    static bool write_chrome_trace(const std::string &path) {
+        std::ofstream file(path);
+        if (!file) {
+            return false;
+        }
+
+        write_chrome_trace(file);
+        return (bool) file;
+    }
+};
+
+} // namespace stepwise